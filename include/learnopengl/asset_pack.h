@@ -0,0 +1,449 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <learnopengl/mapped_file.h>
+
+#ifdef PROJECT_BASE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Single-file archive of the resources, mapped once so loading a scene doesn't open thousands of loose files.
+// Paths are stored relative to the directory of the pack, '/' separated.
+//
+// layout (native endianness):
+//   header : magic, version, entry count, bucket count, entries offset, strings offset
+//   buckets: bucket count (a power of two) x uint32, entry index + 1 or 0 if empty, linear probing on the path hash
+//   entries: one PackEntry per file
+//   strings: entry paths
+//   data   : every entry starts on an ASSET_PACK_ALIGNMENT boundary, so stored entries are page aligned in the mapping
+
+const uint32_t ASSET_PACK_MAGIC = 0x4B504752; // "RGPK"
+const uint32_t ASSET_PACK_VERSION = 1;
+const uint64_t ASSET_PACK_ALIGNMENT = 4096;
+// the pack main opens at startup and --pack writes, next to the resources directory
+const char *const ASSET_PACK_FILE = "resources.pack";
+
+enum AssetCompression : uint32_t {
+    ASSET_STORED = 0,
+    ASSET_ZSTD = 1
+};
+
+struct PackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t bucketCount;
+    uint64_t entriesOffset;
+    uint64_t stringsOffset;
+};
+
+struct PackEntry {
+    uint64_t pathHash;
+    uint64_t offset;
+    uint64_t storedSize;
+    uint64_t size;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+    uint32_t compression;
+    uint32_t reserved;
+};
+
+// bytes of a file, valid while the pack (or the AssetFile it came from) stays open
+struct AssetView {
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+
+    bool found() const { return data != nullptr; }
+};
+
+class AssetPack
+{
+public:
+    // the pack every loader looks into, closed packs contain nothing
+    static AssetPack &shared()
+    {
+        static AssetPack pack;
+        return pack;
+    }
+
+    // maps the pack at path, returns false if there is none or it is damaged
+    bool open(const std::string &path)
+    {
+        close();
+        if (!file.open(path))
+            return false;
+        if (file.size() < sizeof(PackHeader))
+            return fail(path);
+        std::memcpy(&header, file.bytes(), sizeof(header));
+        if (header.magic != ASSET_PACK_MAGIC || header.version != ASSET_PACK_VERSION || header.bucketCount == 0 ||
+            (header.bucketCount & (header.bucketCount - 1)) != 0 || header.bucketCount < header.entryCount)
+            return fail(path);
+        size_t bucketsEnd = sizeof(PackHeader) + (size_t)header.bucketCount * sizeof(uint32_t);
+        size_t entriesEnd = header.entriesOffset + (size_t)header.entryCount * sizeof(PackEntry);
+        if (header.entriesOffset < bucketsEnd || header.entriesOffset % alignof(PackEntry) != 0 ||
+            entriesEnd > header.stringsOffset || header.stringsOffset > file.size())
+            return fail(path);
+        buckets = reinterpret_cast<const uint32_t *>(file.bytes() + sizeof(PackHeader));
+        entries = reinterpret_cast<const PackEntry *>(file.bytes() + header.entriesOffset);
+        strings = reinterpret_cast<const char *>(file.bytes() + header.stringsOffset);
+        for (uint32_t i = 0; i < header.entryCount; i++)
+        {
+            const PackEntry &entry = entries[i];
+            // stored entries are served in place, their size is what the pack holds. Bounds are compared without sums
+            // that could wrap around.
+            uint64_t pathsSize = file.size() - header.stringsOffset;
+            if (entry.storedSize > file.size() || entry.offset > file.size() - entry.storedSize ||
+                (entry.compression == ASSET_STORED && entry.size != entry.storedSize) ||
+                entry.pathOffset > pathsSize || entry.pathLength > pathsSize - entry.pathOffset)
+                return fail(path);
+        }
+        for (uint32_t i = 0; i < header.bucketCount; i++)
+            if (buckets[i] > header.entryCount)
+                return fail(path);
+
+        size_t slash = path.find_last_of('/');
+        root = slash == std::string::npos ? "" : path.substr(0, slash);
+        decompressed.clear();
+        decompressed.resize(header.entryCount);
+        std::cout << "ASSET_PACK:: " << path << ": " << header.entryCount << " files" << std::endl;
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        buckets = nullptr;
+        entries = nullptr;
+        strings = nullptr;
+        decompressed.clear();
+        root.clear();
+    }
+
+    bool isOpen() const { return file.isOpen(); }
+
+    bool contains(const std::string &path) const
+    {
+        return lookup(path) >= 0;
+    }
+
+    // bytes of the file at path (relative to the working directory or absolute), or an empty view if the
+    // pack doesn't have it. Compressed entries are decompressed on first access and kept. Thread safe.
+    AssetView find(const std::string &path)
+    {
+        long index = lookup(path);
+        if (index < 0)
+            return AssetView();
+        const PackEntry &entry = entries[index];
+        AssetView view;
+        if (entry.compression == ASSET_STORED)
+        {
+            view.data = file.bytes() + entry.offset;
+            view.size = (size_t)entry.size;
+            return view;
+        }
+
+        std::lock_guard<std::mutex> lock(decompressMutex);
+        if (!decompressed[index])
+        {
+            std::unique_ptr<std::vector<unsigned char>> bytes(new std::vector<unsigned char>((size_t)entry.size));
+            if (!decompress(entry, *bytes))
+            {
+                std::cout << "ERROR::ASSET_PACK:: can't decompress " << path << std::endl;
+                return AssetView();
+            }
+            decompressed[index] = std::move(bytes);
+        }
+        // an empty vector has no data pointer, point empty files at the (unused) stored bytes
+        view.data = decompressed[index]->empty() ? file.bytes() + entry.offset : decompressed[index]->data();
+        view.size = decompressed[index]->size();
+        return view;
+    }
+
+    // packs every file below directories (relative to the pack's directory) into a new pack at packPath,
+    // except caches (see isCacheFile). With zstd available, entries are compressed unless they are already
+    // (JPG/PNG) or it saves less than 10%.
+    static bool write(const std::string &packPath, const std::vector<std::string> &directories)
+    {
+        size_t slash = packPath.find_last_of('/');
+        std::string base = slash == std::string::npos ? "" : packPath.substr(0, slash + 1);
+        std::vector<std::string> paths;
+        for (const std::string &directory : directories)
+            listFiles(base, directory, paths);
+        std::string packName = packPath.substr(base.size());
+        paths.erase(std::remove(paths.begin(), paths.end(), packName), paths.end());
+        std::sort(paths.begin(), paths.end());
+
+        PackHeader header;
+        header.magic = ASSET_PACK_MAGIC;
+        header.version = ASSET_PACK_VERSION;
+        header.entryCount = (uint32_t)paths.size();
+        header.bucketCount = 1;
+        while (header.bucketCount < header.entryCount * 2)
+            header.bucketCount *= 2;
+        header.entriesOffset = alignUp(sizeof(PackHeader) + (uint64_t)header.bucketCount * sizeof(uint32_t), alignof(PackEntry));
+        header.stringsOffset = header.entriesOffset + (uint64_t)paths.size() * sizeof(PackEntry);
+
+        std::vector<uint32_t> buckets(header.bucketCount, 0);
+        std::vector<PackEntry> entries(paths.size());
+        std::string strings;
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            PackEntry &entry = entries[i];
+            std::memset(&entry, 0, sizeof(entry));
+            entry.pathHash = HashBytes(paths[i].data(), paths[i].size());
+            entry.pathOffset = (uint32_t)strings.size();
+            entry.pathLength = (uint32_t)paths[i].size();
+            strings += paths[i];
+            uint32_t bucket = (uint32_t)entry.pathHash & (header.bucketCount - 1);
+            while (buckets[bucket] != 0)
+                bucket = (bucket + 1) & (header.bucketCount - 1);
+            buckets[bucket] = (uint32_t)i + 1;
+        }
+
+        std::string temporaryPath = packPath + ".tmp";
+        std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            std::cout << "ERROR::ASSET_PACK:: can't write " << packPath << std::endl;
+            return false;
+        }
+        // the table is written last, once every entry's offset and size is known
+        uint64_t offset = alignUp(header.stringsOffset + strings.size(), ASSET_PACK_ALIGNMENT);
+        uint64_t totalSize = 0, totalStored = 0;
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            MappedFile source(base + paths[i]);
+            std::vector<unsigned char> stored;
+            PackEntry &entry = entries[i];
+            entry.offset = offset;
+            entry.size = source.size();
+            entry.compression = compress(paths[i], source, stored) ? ASSET_ZSTD : ASSET_STORED;
+            const unsigned char *bytes = entry.compression == ASSET_ZSTD ? stored.data() : source.bytes();
+            entry.storedSize = entry.compression == ASSET_ZSTD ? stored.size() : source.size();
+            out.seekp((std::streamoff)offset);
+            if (entry.storedSize > 0)
+                out.write(reinterpret_cast<const char *>(bytes), (std::streamsize)entry.storedSize);
+            offset = alignUp(offset + entry.storedSize, ASSET_PACK_ALIGNMENT);
+            totalSize += entry.size;
+            totalStored += entry.storedSize;
+        }
+        out.seekp(0);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(buckets.data()), buckets.size() * sizeof(uint32_t));
+        out.seekp((std::streamoff)header.entriesOffset);
+        out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(PackEntry));
+        out.write(strings.data(), (std::streamsize)strings.size());
+        out.close();
+        if (!out || std::rename(temporaryPath.c_str(), packPath.c_str()) != 0)
+        {
+            std::remove(temporaryPath.c_str());
+            std::cout << "ERROR::ASSET_PACK:: can't write " << packPath << std::endl;
+            return false;
+        }
+        std::cout << "ASSET_PACK:: wrote " << paths.size() << " files to " << packPath << ", "
+                  << totalSize << " -> " << totalStored << " bytes" << std::endl;
+        return true;
+    }
+
+private:
+    MappedFile file;
+    PackHeader header;
+    const uint32_t *buckets = nullptr;
+    const PackEntry *entries = nullptr;
+    const char *strings = nullptr;
+    // directory of the pack, entry paths are relative to it
+    std::string root;
+    std::mutex decompressMutex;
+    std::vector<std::unique_ptr<std::vector<unsigned char>>> decompressed;
+
+    bool fail(const std::string &path)
+    {
+        std::cout << "ERROR::ASSET_PACK:: " << path << " is not a valid pack" << std::endl;
+        close();
+        return false;
+    }
+
+    static uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    long lookup(const std::string &path) const
+    {
+        if (!isOpen() || header.entryCount == 0)
+            return -1;
+        std::string key = normalize(path);
+        uint64_t hash = HashBytes(key.data(), key.size());
+        for (uint32_t probe = 0; probe < header.bucketCount; probe++)
+        {
+            uint32_t slot = buckets[((uint32_t)hash + probe) & (header.bucketCount - 1)];
+            if (slot == 0)
+                return -1;
+            const PackEntry &entry = entries[slot - 1];
+            if (entry.pathHash == hash && entry.pathLength == key.size() &&
+                std::memcmp(strings + entry.pathOffset, key.data(), key.size()) == 0)
+                return (long)slot - 1;
+        }
+        return -1;
+    }
+
+    // path relative to the pack's directory with "." and ".." resolved, model files reference their
+    // textures and buffers relative to themselves
+    std::string normalize(const std::string &path) const
+    {
+        std::string relative = path;
+        std::replace(relative.begin(), relative.end(), '\\', '/');
+        if (!root.empty() && relative.compare(0, root.size() + 1, root + "/") == 0)
+            relative = relative.substr(root.size() + 1);
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (start <= relative.size())
+        {
+            size_t end = relative.find('/', start);
+            if (end == std::string::npos)
+                end = relative.size();
+            std::string part = relative.substr(start, end - start);
+            if (part == "..")
+            {
+                if (!parts.empty() && parts.back() != "..")
+                    parts.pop_back();
+                else
+                    parts.push_back(part);
+            }
+            else if (!part.empty() && part != ".")
+            {
+                parts.push_back(part);
+            }
+            start = end + 1;
+        }
+        std::string key;
+        for (const std::string &part : parts)
+            key += (key.empty() ? "" : "/") + part;
+        return key;
+    }
+
+    bool decompress(const PackEntry &entry, std::vector<unsigned char> &out) const
+    {
+#ifdef PROJECT_BASE_HAVE_ZSTD
+        if (entry.compression == ASSET_ZSTD)
+        {
+            size_t size = ZSTD_decompress(out.data(), out.size(), file.bytes() + entry.offset, (size_t)entry.storedSize);
+            return !ZSTD_isError(size) && size == out.size();
+        }
+#endif
+        return false;
+    }
+
+    static bool compress(const std::string &path, const MappedFile &source, std::vector<unsigned char> &out)
+    {
+#ifdef PROJECT_BASE_HAVE_ZSTD
+        std::string extension = path.substr(path.find_last_of('.') + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (!source.isOpen() || extension == "jpg" || extension == "jpeg" || extension == "png")
+            return false;
+        out.resize(ZSTD_compressBound(source.size()));
+        size_t size = ZSTD_compress(out.data(), out.size(), source.bytes(), source.size(), 9);
+        if (ZSTD_isError(size) || size > source.size() / 10 * 9)
+            return false;
+        out.resize(size);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // appends the regular files below base + directory to paths, relative to base
+    static void listFiles(const std::string &base, const std::string &directory, std::vector<std::string> &paths)
+    {
+        DIR *dir = opendir((base + directory).c_str());
+        if (!dir)
+            return;
+        while (dirent *child = readdir(dir))
+        {
+            std::string name = child->d_name;
+            if (name == "." || name == "..")
+                continue;
+            std::string path = directory + "/" + name;
+            struct stat st;
+            if (stat((base + path).c_str(), &st) != 0)
+                continue;
+            if (S_ISDIR(st.st_mode) && name != "shader_cache")
+                listFiles(base, path, paths);
+            else if (S_ISREG(st.st_mode) && !isCacheFile(name))
+                paths.push_back(path);
+        }
+        closedir(dir);
+    }
+
+    // Caches written at runtime: cooked meshes (see MeshCache), program binaries (shader_cache/, see
+    // ProgramBinaryCache) and half-written files of either. They are rewritten whenever they go stale, a
+    // packed copy would shadow the fresh file on disk, so they are always read from disk.
+    static bool isCacheFile(const std::string &name)
+    {
+        for (const char *suffix : {".cooked", ".tmp"})
+        {
+            size_t length = std::strlen(suffix);
+            if (name.size() >= length && name.compare(name.size() - length, length, suffix) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+// a file read from the shared AssetPack if it contains it, mapped from disk otherwise
+class AssetFile
+{
+public:
+    AssetFile() = default;
+
+    explicit AssetFile(const std::string &path)
+    {
+        open(path);
+    }
+
+    AssetFile(const AssetFile &) = delete;
+    AssetFile &operator=(const AssetFile &) = delete;
+
+    bool open(const std::string &path)
+    {
+        close();
+        asset = AssetPack::shared().find(path);
+        if (!asset.found() && disk.open(path))
+        {
+            asset.data = disk.bytes();
+            asset.size = disk.size();
+        }
+        return isOpen();
+    }
+
+    void close()
+    {
+        disk.close();
+        asset = AssetView();
+    }
+
+    bool isOpen() const { return asset.found(); }
+    const unsigned char *bytes() const { return asset.data; }
+    size_t size() const { return asset.size; }
+
+private:
+    AssetView asset;
+    MappedFile disk;
+};
+
+#endif
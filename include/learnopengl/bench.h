@@ -0,0 +1,222 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/camera.h>
+#include <learnopengl/render_stats.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// command line of the headless benchmark:
+//   --bench [--frames N] [--warmup N] [--out file.json] [--prepass] [--no-mdi] [--gpu-cull] [--occlusion]
+struct BenchOptions {
+    bool enabled = false;
+    // start with the depth pre-pass on
+    bool depthPrepass = false;
+    // --no-mdi measures the GL 3.3 draw loop on drivers with multi-draw indirect
+    bool multiDrawIndirect = true;
+    // cull and draw the meteors with compute shaders (GL 4.3)
+    bool gpuCulling = false;
+    // skip models and meteors that occlusion queries found hidden
+    bool occlusionCulling = false;
+    unsigned int frames = 600;
+    unsigned int warmupFrames = 30;
+    std::string outputPath;
+
+    static BenchOptions parse(int argc, char **argv)
+    {
+        BenchOptions options;
+        for (int i = 1; i < argc; i++)
+        {
+            bool hasValue = i + 1 < argc;
+            if (std::strcmp(argv[i], "--bench") == 0)
+                options.enabled = true;
+            else if (std::strcmp(argv[i], "--frames") == 0 && hasValue)
+                options.frames = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+            else if (std::strcmp(argv[i], "--warmup") == 0 && hasValue)
+                options.warmupFrames = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+            else if (std::strcmp(argv[i], "--out") == 0 && hasValue)
+                options.outputPath = argv[++i];
+            else if (std::strcmp(argv[i], "--prepass") == 0)
+                options.depthPrepass = true;
+            else if (std::strcmp(argv[i], "--no-mdi") == 0)
+                options.multiDrawIndirect = false;
+            else if (std::strcmp(argv[i], "--gpu-cull") == 0)
+                options.gpuCulling = true;
+            else if (std::strcmp(argv[i], "--occlusion") == 0)
+                options.occlusionCulling = true;
+            else
+                std::cerr << "WARNING::BENCH:: ignoring argument " << argv[i] << std::endl;
+        }
+        return options;
+    }
+};
+
+// the real stdout, which BenchRecorder::write prints to
+inline std::streambuf *&BenchStdout()
+{
+    static std::streambuf *buffer = std::cout.rdbuf();
+    return buffer;
+}
+
+// sends everything printed to std::cout from now on (loader messages, warnings) to stderr, so a benchmark
+// that prints its JSON to stdout can be piped into a parser
+inline void RedirectBenchDiagnostics()
+{
+    BenchStdout() = std::cout.rdbuf(std::cerr.rdbuf());
+}
+
+// deterministic camera flight for benchmark runs: an orbit around the scene that bobs up and down,
+// always looking at the platform, so every run renders exactly the same frames
+struct BenchCameraPath {
+    // seconds of scene time per frame, the benchmark doesn't follow the wall clock
+    static constexpr float TIME_STEP = 1.0f / 60.0f;
+
+    static void apply(Camera &camera, float time)
+    {
+        float angle = time * 0.3f;
+        camera.Position = glm::vec3(55.0f * std::cos(angle), 12.0f + 8.0f * std::sin(time * 0.5f), 55.0f * std::sin(angle));
+        camera.LookAt(glm::vec3(0.0f, 5.0f, 0.0f));
+    }
+};
+
+// collects frame times and draw counters of the recorded frames and writes the summary as JSON
+class BenchRecorder
+{
+public:
+    void beginFrame()
+    {
+        RenderStats::frame().reset();
+        frameStart = std::chrono::steady_clock::now();
+    }
+
+    // waits for the GPU to finish the frame so the time covers all of its work
+    void endFrame()
+    {
+        glFinish();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - frameStart;
+        frameTimes.push_back(elapsed.count());
+        drawCalls.push_back(RenderStats::frame().drawCalls);
+        triangles.push_back((double)RenderStats::frame().triangles);
+        stateCalls.push_back(RenderStats::frame().stateCalls);
+        redundantStateCalls.push_back(RenderStats::frame().redundantStateCalls);
+    }
+
+    // records a per-frame GPU time, written as "<name>_ms" next to the frame times
+    void addTiming(const std::string &name, double milliseconds)
+    {
+        for (auto &timing : timings)
+        {
+            if (timing.first == name)
+            {
+                timing.second.push_back(milliseconds);
+                return;
+            }
+        }
+        timings.emplace_back(name, std::vector<double>(1, milliseconds));
+    }
+
+    // drops everything recorded so far, used after the warm-up frames
+    void clear()
+    {
+        frameTimes.clear();
+        drawCalls.clear();
+        triangles.clear();
+        stateCalls.clear();
+        redundantStateCalls.clear();
+        timings.clear();
+    }
+
+    void writeJson(std::ostream &out, int width, int height) const
+    {
+        const char *renderer = (const char *)glGetString(GL_RENDERER);
+        out << "{\n"
+            << "  \"renderer\": \"" << (renderer ? renderer : "unknown") << "\",\n"
+            << "  \"width\": " << width << ",\n"
+            << "  \"height\": " << height << ",\n"
+            << "  \"frames\": " << frameTimes.size() << ",\n";
+        writeSummary(out, "frame_ms", frameTimes);
+        out << ",\n";
+        writeSummary(out, "draw_calls", drawCalls);
+        out << ",\n";
+        writeSummary(out, "triangles", triangles);
+        out << ",\n";
+        writeSummary(out, "state_calls", stateCalls);
+        out << ",\n";
+        writeSummary(out, "redundant_state_calls", redundantStateCalls);
+        for (const auto &timing : timings)
+        {
+            out << ",\n";
+            writeSummary(out, (timing.first + "_ms").c_str(), timing.second);
+        }
+        out << "\n}" << std::endl;
+    }
+
+    // writes to path, or to stdout if path is empty
+    bool write(const std::string &path, int width, int height) const
+    {
+        if (path.empty())
+        {
+            std::ostream out(BenchStdout());
+            writeJson(out, width, height);
+            return true;
+        }
+        std::ofstream out(path);
+        if (!out)
+        {
+            std::cout << "ERROR::BENCH:: can't write " << path << std::endl;
+            return false;
+        }
+        writeJson(out, width, height);
+        return true;
+    }
+
+private:
+    std::chrono::steady_clock::time_point frameStart;
+    std::vector<double> frameTimes;
+    std::vector<double> drawCalls;
+    std::vector<double> triangles;
+    std::vector<double> stateCalls;
+    std::vector<double> redundantStateCalls;
+    std::vector<std::pair<std::string, std::vector<double>>> timings;
+
+    // nearest-rank percentile of sorted values
+    static double percentile(const std::vector<double> &sorted, double p)
+    {
+        size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+        return sorted[rank == 0 ? 0 : rank - 1];
+    }
+
+    static void writeSummary(std::ostream &out, const char *name, std::vector<double> values)
+    {
+        out << "  \"" << name << "\": {";
+        if (values.empty())
+        {
+            out << "}";
+            return;
+        }
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (double value : values)
+            sum += value;
+        out << "\"min\": " << values.front()
+            << ", \"avg\": " << sum / values.size()
+            << ", \"p50\": " << percentile(values, 50.0)
+            << ", \"p95\": " << percentile(values, 95.0)
+            << ", \"p99\": " << percentile(values, 99.0)
+            << ", \"max\": " << values.back() << "}";
+    }
+};
+
+#endif
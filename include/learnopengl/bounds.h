@@ -0,0 +1,148 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// axis aligned bounding box, starts out empty (min > max) and grows with expand()
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool valid() const
+    {
+        return min.x <= max.x && min.y <= max.y && min.z <= max.z;
+    }
+
+    void expand(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void expand(const AABB &other)
+    {
+        if (!other.valid())
+            return;
+        expand(other.min);
+        expand(other.max);
+    }
+
+    bool contains(const glm::vec3 &point) const
+    {
+        return point.x >= min.x && point.y >= min.y && point.z >= min.z &&
+               point.x <= max.x && point.y <= max.y && point.z <= max.z;
+    }
+
+    glm::vec3 center() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 extents() const
+    {
+        return (max - min) * 0.5f;
+    }
+
+    // box enclosing this box after transform (Arvo's method: transformed center plus |M| * extents)
+    AABB transformed(const glm::mat4 &transform) const
+    {
+        if (!valid())
+            return *this;
+        glm::vec3 c = glm::vec3(transform * glm::vec4(center(), 1.0f));
+        glm::vec3 e = extents();
+        glm::vec3 r;
+        for (int i = 0; i < 3; i++)
+            r[i] = std::abs(transform[0][i]) * e.x + std::abs(transform[1][i]) * e.y + std::abs(transform[2][i]) * e.z;
+        AABB result;
+        result.min = c - r;
+        result.max = c + r;
+        return result;
+    }
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    // sphere enclosing this sphere after transform, the radius grows with the largest axis scale
+    BoundingSphere transformed(const glm::mat4 &transform) const
+    {
+        BoundingSphere result;
+        result.center = glm::vec3(transform * glm::vec4(center, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(transform[0])),
+                               std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+        result.radius = radius * scale;
+        return result;
+    }
+};
+
+// the six planes of a view frustum, normals point inwards and are normalized
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // extracts the planes from a projection * view (* model) matrix (Gribb/Hartmann). Planes are in the
+    // space the matrix transforms from, world space for projection * view.
+    static Frustum fromMatrix(const glm::mat4 &m)
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        Frustum frustum;
+        frustum.planes[0] = row3 + row0; // left
+        frustum.planes[1] = row3 - row0; // right
+        frustum.planes[2] = row3 + row1; // bottom
+        frustum.planes[3] = row3 - row1; // top
+        frustum.planes[4] = row3 + row2; // near
+        frustum.planes[5] = row3 - row2; // far
+        for (glm::vec4 &plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    bool intersects(const BoundingSphere &sphere) const
+    {
+        for (const glm::vec4 &plane : planes)
+            if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+                return false;
+        return true;
+    }
+
+    // conservative: boxes crossing the corner regions outside the frustum may be reported as visible
+    bool intersects(const AABB &box) const
+    {
+        if (!box.valid())
+            return false;
+        glm::vec3 c = box.center();
+        glm::vec3 e = box.extents();
+        for (const glm::vec4 &plane : planes)
+        {
+            float r = e.x * std::abs(plane.x) + e.y * std::abs(plane.y) + e.z * std::abs(plane.z);
+            if (glm::dot(glm::vec3(plane), c) + plane.w < -r)
+                return false;
+        }
+        return true;
+    }
+};
+
+// per-frame culling counters, one item is one mesh of one object instance
+struct CullStats {
+    unsigned int drawn = 0;
+    unsigned int culled = 0;
+    // meshes inside the frustum that occlusion queries found hidden
+    unsigned int occluded = 0;
+
+    void reset()
+    {
+        drawn = 0;
+        culled = 0;
+        occluded = 0;
+    }
+};
+
+#endif
@@ -5,6 +5,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <learnopengl/bounds.h>
+
 #include <vector>
 
 // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
@@ -61,11 +63,17 @@ public:
     }
 
     // returns the view matrix calculated using Euler Angles and the LookAt Matrix
-    glm::mat4 GetViewMatrix()
+    glm::mat4 GetViewMatrix() const
     {
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    // returns the world space planes of the view frustum seen through projection
+    Frustum GetFrustum(const glm::mat4 &projection) const
+    {
+        return Frustum::fromMatrix(projection * GetViewMatrix());
+    }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
@@ -102,6 +110,15 @@ public:
         updateCameraVectors();
     }
 
+    // turns the camera towards target, keeping its position
+    void LookAt(const glm::vec3 &target)
+    {
+        glm::vec3 direction = glm::normalize(target - Position);
+        Yaw = glm::degrees(atan2(direction.z, direction.x));
+        Pitch = glm::degrees(asin(direction.y));
+        updateCameraVectors();
+    }
+
     // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
     void ProcessMouseScroll(float yoffset)
     {
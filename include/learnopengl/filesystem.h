@@ -3,20 +3,43 @@
 
 #include <string>
 #include <cstdlib>
+#include <fstream>
+#include <sstream>
 #include "root_directory.h" // This is a configuration file generated by CMake.
 
+#include <learnopengl/asset_pack.h>
+
 class FileSystem
 {
 private:
   typedef std::string (*Builder) (const std::string& path);
 
 public:
+  // paths built here are also the keys of the AssetPack, it strips the root again
   static std::string getPath(const std::string& path)
   {
     static std::string(*pathBuilder)(std::string const &) = getPathBuilder();
     return (*pathBuilder)(path);
   }
 
+  // reads the whole file at path, from the shared AssetPack if it has it and from disk otherwise
+  static bool readFileContents(const std::string& path, std::string& contents)
+  {
+    AssetView asset = AssetPack::shared().find(path);
+    if (asset.found())
+    {
+      contents.assign(reinterpret_cast<const char *>(asset.data), asset.size);
+      return true;
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+      return false;
+    std::stringstream stream;
+    stream << file.rdbuf();
+    contents = stream.str();
+    return true;
+  }
+
 private:
   static std::string const & getRoot()
   {
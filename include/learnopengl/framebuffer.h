@@ -0,0 +1,63 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+
+#include <iostream>
+
+// offscreen render target: RGBA8 color renderbuffer and a 24-bit depth texture that can be sampled later
+class Framebuffer
+{
+public:
+    unsigned int ID;
+    unsigned int colorBuffer;
+    unsigned int depthTexture;
+    int width;
+    int height;
+
+    Framebuffer(int width, int height) : width(width), height(height)
+    {
+        glGenFramebuffers(1, &ID);
+        glBindFramebuffer(GL_FRAMEBUFFER, ID);
+
+        glGenRenderbuffers(1, &colorBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+
+        glGenTextures(1, &depthTexture);
+        GLState::shared().bindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    Framebuffer(const Framebuffer &) = delete;
+    Framebuffer &operator=(const Framebuffer &) = delete;
+
+    ~Framebuffer()
+    {
+        glDeleteFramebuffers(1, &ID);
+        glDeleteRenderbuffers(1, &colorBuffer);
+        GLState::shared().forgetTexture(depthTexture);
+        glDeleteTextures(1, &depthTexture);
+    }
+
+    // binds the framebuffer for drawing and sets the viewport to its size
+    void bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, ID);
+        glViewport(0, 0, width, height);
+    }
+};
+
+#endif
@@ -0,0 +1,284 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/render_stats.h>
+
+#include <cstring>
+
+// texture units whose bindings are tracked, binds to higher units are always issued
+const unsigned int GL_STATE_TEXTURE_UNITS = 16;
+
+// GL 4.x entry points are loaded by hand where they are used, glad is generated for 3.3 core only
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// version of the current context is at least major.minor
+inline bool GLVersionAtLeast(GLint major, GLint minor)
+{
+    GLint contextMajor = 0, contextMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+// the current context exposes extension name, e.g. "GL_ARB_multi_draw_indirect"
+inline bool HasGLExtension(const char *name)
+{
+    GLint extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+    for (GLint i = 0; i < extensions; i++)
+    {
+        const char *extension = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, (GLuint)i));
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Shadow copy of the GL state the renderer changes per draw: program, vertex array, buffers, texture units
+// and the depth, cull, blend and color mask settings. A call that wouldn't change the driver's state is
+// skipped, every call is counted in RenderStats::frame() as issued or skipped.
+//
+// The copy only stays right if all of these go through GLState::shared(). Objects deleted behind its back
+// have to be forgotten (glDelete* unbinds them, their names are then reused), and after GL calls that bypass
+// it invalidate() makes the next call of every kind go to the driver.
+class GLState
+{
+public:
+    static GLState &shared()
+    {
+        static GLState state;
+        return state;
+    }
+
+    // forgets everything, the next call of every kind is issued
+    void invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        arrayBuffer = UNKNOWN;
+        elementBuffer = UNKNOWN;
+        uniformBuffer = UNKNOWN;
+        drawIndirectBuffer = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+        {
+            textures2D[unit] = UNKNOWN;
+            texturesCube[unit] = UNKNOWN;
+        }
+        depthTest = cullFaceEnabled = blend = UNKNOWN;
+        depthFunction = UNKNOWN;
+        depthWrite = UNKNOWN;
+        colorWrite = UNKNOWN;
+        cullMode = UNKNOWN;
+        frontFaceMode = UNKNOWN;
+        blendSource = blendDestination = UNKNOWN;
+    }
+
+    void useProgram(GLuint id)
+    {
+        if (changes(program, id))
+            glUseProgram(id);
+    }
+
+    // the element buffer binding is part of the vertex array, it's unknown after a switch
+    void bindVertexArray(GLuint id)
+    {
+        if (changes(vertexArray, id))
+        {
+            glBindVertexArray(id);
+            elementBuffer = UNKNOWN;
+        }
+    }
+
+    void bindBuffer(GLenum target, GLuint id)
+    {
+        GLuint *cached = bufferSlot(target);
+        if (!cached || changes(*cached, id))
+        {
+            if (!cached)
+                RenderStats::frame().stateCalls++;
+            glBindBuffer(target, id);
+        }
+    }
+
+    void activeTexture(unsigned int unit)
+    {
+        if (changes(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // binds texture to target of unit, the active unit is only switched if the binding changes
+    void bindTexture(unsigned int unit, GLenum target, GLuint id)
+    {
+        GLuint *cached = textureSlot(unit, target);
+        if (cached && *cached == id)
+        {
+            RenderStats::frame().redundantStateCalls++;
+            return;
+        }
+        activeTexture(unit);
+        RenderStats::frame().stateCalls++;
+        glBindTexture(target, id);
+        if (cached)
+            *cached = id;
+    }
+
+    // binds texture to target of the active unit, for uploads that don't care about the unit
+    void bindTexture(GLenum target, GLuint id)
+    {
+        bindTexture(activeUnit == UNKNOWN ? 0 : activeUnit, target, id);
+    }
+
+    // GL_DEPTH_TEST, GL_CULL_FACE or GL_BLEND
+    void setEnabled(GLenum capability, bool enabled)
+    {
+        GLuint *cached = capability == GL_DEPTH_TEST ? &depthTest : capability == GL_CULL_FACE ? &cullFaceEnabled :
+                         capability == GL_BLEND ? &blend : nullptr;
+        if (cached && !changes(*cached, (GLuint)enabled))
+            return;
+        if (!cached)
+            RenderStats::frame().stateCalls++;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    void depthFunc(GLenum function)
+    {
+        if (changes(depthFunction, function))
+            glDepthFunc(function);
+    }
+
+    void depthMask(bool write)
+    {
+        if (changes(depthWrite, (GLuint)write))
+            glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    // all four channels together, the renderer never masks single channels
+    void colorMask(bool write)
+    {
+        if (changes(colorWrite, (GLuint)write))
+        {
+            GLboolean value = write ? GL_TRUE : GL_FALSE;
+            glColorMask(value, value, value, value);
+        }
+    }
+
+    void cullFace(GLenum face)
+    {
+        if (changes(cullMode, face))
+            glCullFace(face);
+    }
+
+    void frontFace(GLenum mode)
+    {
+        if (changes(frontFaceMode, mode))
+            glFrontFace(mode);
+    }
+
+    void blendFunc(GLenum source, GLenum destination)
+    {
+        if (blendSource == source && blendDestination == destination)
+        {
+            RenderStats::frame().redundantStateCalls++;
+            return;
+        }
+        blendSource = source;
+        blendDestination = destination;
+        RenderStats::frame().stateCalls++;
+        glBlendFunc(source, destination);
+    }
+
+    // call before glDelete* of an object that may be bound
+    void forgetProgram(GLuint id)
+    {
+        if (program == id)
+            program = UNKNOWN;
+    }
+
+    void forgetVertexArray(GLuint id)
+    {
+        if (vertexArray == id)
+            vertexArray = UNKNOWN;
+    }
+
+    void forgetBuffer(GLuint id)
+    {
+        for (GLuint *cached : {&arrayBuffer, &elementBuffer, &uniformBuffer, &drawIndirectBuffer})
+            if (*cached == id)
+                *cached = UNKNOWN;
+    }
+
+    void forgetTexture(GLuint id)
+    {
+        for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+        {
+            if (textures2D[unit] == id)
+                textures2D[unit] = UNKNOWN;
+            if (texturesCube[unit] == id)
+                texturesCube[unit] = UNKNOWN;
+        }
+    }
+
+private:
+    static const GLuint UNKNOWN = ~0u;
+
+    GLuint program, vertexArray;
+    GLuint arrayBuffer, elementBuffer, uniformBuffer, drawIndirectBuffer;
+    GLuint activeUnit;
+    GLuint textures2D[GL_STATE_TEXTURE_UNITS];
+    GLuint texturesCube[GL_STATE_TEXTURE_UNITS];
+    GLuint depthTest, cullFaceEnabled, blend;
+    GLuint depthFunction, depthWrite, colorWrite;
+    GLuint cullMode, frontFaceMode;
+    GLuint blendSource, blendDestination;
+
+    GLState()
+    {
+        invalidate();
+    }
+
+    // true (and counted as issued) if value differs from the cached one, which it then replaces
+    static bool changes(GLuint &cached, GLuint value)
+    {
+        if (cached == value)
+        {
+            RenderStats::frame().redundantStateCalls++;
+            return false;
+        }
+        cached = value;
+        RenderStats::frame().stateCalls++;
+        return true;
+    }
+
+    GLuint *bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER: return &arrayBuffer;
+        case GL_ELEMENT_ARRAY_BUFFER: return &elementBuffer;
+        case GL_UNIFORM_BUFFER: return &uniformBuffer;
+        case GL_DRAW_INDIRECT_BUFFER: return &drawIndirectBuffer;
+        default: return nullptr;
+        }
+    }
+
+    GLuint *textureSlot(unsigned int unit, GLenum target)
+    {
+        if (unit >= GL_STATE_TEXTURE_UNITS)
+            return nullptr;
+        if (target == GL_TEXTURE_2D)
+            return &textures2D[unit];
+        if (target == GL_TEXTURE_CUBE_MAP)
+            return &texturesCube[unit];
+        return nullptr;
+    }
+};
+
+#endif
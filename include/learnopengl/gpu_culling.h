@@ -0,0 +1,387 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/lod.h>
+#include <learnopengl/model.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/shader_variants.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+// GL 4.2 / 4.3, glad is generated for 3.3 core only
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+
+typedef void (APIENTRYP PFNGPUCULLERDISPATCHCOMPUTEPROC)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+typedef void (APIENTRYP PFNGPUCULLERMEMORYBARRIERPROC)(GLbitfield barriers);
+typedef void (APIENTRYP PFNGPUCULLERBINDIMAGETEXTUREPROC)(GLuint unit, GLuint texture, GLint level, GLboolean layered,
+                                                          GLint layer, GLenum access, GLenum format);
+
+// local sizes of the compute shaders
+const unsigned int GPU_CULL_GROUP_SIZE = 64;
+const unsigned int GPU_CULL_PYRAMID_GROUP_SIZE = 8;
+// levels of detail cull_instances.cs can pick from, see MAX_LODS there
+const unsigned int GPU_CULL_MAX_LODS = 8;
+
+// Culls the instances of one model on the GPU (GL 4.3). The scene is a static buffer of instance matrices,
+// uploaded once. Every frame cull_instances.cs places them with a shared animation matrix, tests their
+// bounding spheres against the frustum and against the depth pyramid of the previous frame, picks a level
+// of detail and appends the model matrices of the survivors to that level's range of the transform buffer.
+// cull_finalize.cs then writes the per-level counts into the instanceCount of prepared draw commands, so
+// the CPU never sees how many instances are drawn. The render queue draws them with submitIndirect.
+//
+// The depth pyramid is built from the frame's depth texture after rendering (buildDepthPyramid). Its level
+// 0 has power of two dimensions, every texel holds the farthest depth of the pixels it covers, so every
+// further level halves exactly and a sphere's screen rectangle is covered by 2x2 texels of one level.
+// Occlusion is tested against the last frame's depths, an object that comes out from behind an occluder
+// may appear a frame late.
+class GpuCuller
+{
+public:
+    GpuCuller() = default;
+    GpuCuller(const GpuCuller &) = delete;
+    GpuCuller &operator=(const GpuCuller &) = delete;
+
+    ~GpuCuller()
+    {
+        GLState &state = GLState::shared();
+        for (unsigned int buffer : {instanceBuffer, transformBuffer, counterBuffer, commandBuffer, commandLodBuffer})
+        {
+            if (buffer != 0)
+            {
+                state.forgetBuffer(buffer);
+                glDeleteBuffers(1, &buffer);
+            }
+        }
+        if (pyramid != 0)
+        {
+            state.forgetTexture(pyramid);
+            glDeleteTextures(1, &pyramid);
+        }
+    }
+
+    // resolves the compute entry points and compiles the programs, call once after gladLoadGLLoader with the
+    // same loader. Returns false and stays unusable on contexts below GL 4.3.
+    bool init(GLADloadproc load)
+    {
+        supported = false;
+        if (!GLVersionAtLeast(4, 3))
+            return false;
+        dispatchCompute = (PFNGPUCULLERDISPATCHCOMPUTEPROC)load("glDispatchCompute");
+        memoryBarrier = (PFNGPUCULLERMEMORYBARRIERPROC)load("glMemoryBarrier");
+        bindImageTexture = (PFNGPUCULLERBINDIMAGETEXTUREPROC)load("glBindImageTexture");
+        if (!dispatchCompute || !memoryBarrier || !bindImageTexture)
+            return false;
+
+        std::vector<std::string> defines = {"LOCAL_SIZE " + std::to_string(GPU_CULL_GROUP_SIZE),
+                                            "MAX_LODS " + std::to_string(GPU_CULL_MAX_LODS)};
+        cullProgram.reset(new Shader("resources/shaders/cull_instances.cs", defines));
+        finalizeProgram.reset(new Shader("resources/shaders/cull_finalize.cs", defines));
+        std::string pyramidGroup = "LOCAL_SIZE " + std::to_string(GPU_CULL_PYRAMID_GROUP_SIZE);
+        pyramidCopyProgram.reset(new Shader("resources/shaders/hiz_build.cs", {pyramidGroup, "COPY_DEPTH"}));
+        pyramidReduceProgram.reset(new Shader("resources/shaders/hiz_build.cs", {pyramidGroup}));
+        // samplers are set while their program is in use
+        cullProgram->use();
+        cullProgram->setInt("depthPyramid", 0);
+        pyramidCopyProgram->use();
+        pyramidCopyProgram->setInt("depthTexture", 0);
+        // the per-frame uniforms are set through handles, cull looks up no names
+        cullInstanceCount = cullProgram->uniform<int>("instanceCount");
+        cullAnimation = cullProgram->uniform<glm::mat4>("animation");
+        cullDecode = cullProgram->uniform<glm::mat4>("decode");
+        cullSphere = cullProgram->uniform<glm::vec4>("sphere");
+        cullFrustumPlanes = cullProgram->uniform<glm::vec4>("frustumPlanes");
+        cullLodCount = cullProgram->uniform<int>("lodCount");
+        cullLodErrors = cullProgram->uniform<float>("lodErrors");
+        cullViewPosition = cullProgram->uniform<glm::vec3>("viewPosition");
+        cullPixelsPerUnit = cullProgram->uniform<float>("pixelsPerUnit");
+        cullMaxPixelError = cullProgram->uniform<float>("maxPixelError");
+        cullOcclusion = cullProgram->uniform<bool>("occlusion");
+        cullPreviousViewProjection = cullProgram->uniform<glm::mat4>("previousViewProjection");
+        cullPyramidSize = cullProgram->uniform<glm::vec2>("pyramidSize");
+        cullPyramidLevels = cullProgram->uniform<int>("pyramidLevels");
+        finalizeCommandCount = finalizeProgram->uniform<int>("commandCount");
+
+        glGenBuffers(1, &instanceBuffer);
+        glGenBuffers(1, &transformBuffer);
+        glGenBuffers(1, &counterBuffer);
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &commandLodBuffer);
+        supported = true;
+        return true;
+    }
+
+    bool isSupported() const { return supported; }
+
+    // the scene: copies of model placed with instances, which are drawn as instances[i] * animation (see
+    // cull). Builds one command per index range, level of detail and mesh of model.
+    void setInstances(Model &model, const std::vector<glm::mat4> &instances)
+    {
+        this->model = &model;
+        instanceCount = (unsigned int)instances.size();
+        lodCount = std::min(model.LodCount(), GPU_CULL_MAX_LODS);
+
+        GLState &state = GLState::shared();
+        state.bindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, instances.size() * sizeof(glm::mat4), instances.data(), GL_STATIC_DRAW);
+        // level l's survivors are written from transform l * instanceCount on
+        state.bindBuffer(GL_SHADER_STORAGE_BUFFER, transformBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)lodCount * instanceCount * sizeof(glm::mat4), NULL, GL_DYNAMIC_COPY);
+        state.bindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, GPU_CULL_MAX_LODS * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::vector<GLuint> commandLods;
+        meshDraws.clear();
+        for (Mesh &mesh : model.meshes)
+        {
+            IndirectDraw draw;
+            draw.commandBuffer = commandBuffer;
+            draw.transformBuffer = transformBuffer;
+            draw.firstCommand = (uint32_t)commands.size();
+            size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+            for (unsigned int lod = 0; lod < lodCount; lod++)
+            {
+                for (const IndexRange &range : mesh.lodRanges[std::min<size_t>(lod, mesh.lods.size())])
+                {
+                    DrawElementsIndirectCommand command;
+                    command.count = (GLuint)range.count;
+                    command.instanceCount = 0;
+                    command.firstIndex = (GLuint)(range.byteOffset / indexSize);
+                    command.baseVertex = range.baseVertex;
+                    command.baseInstance = lod * instanceCount;
+                    commands.push_back(command);
+                    commandLods.push_back(lod);
+                }
+            }
+            draw.commandCount = (uint32_t)commands.size() - draw.firstCommand;
+            meshDraws.push_back(draw);
+        }
+        commandCount = (unsigned int)commands.size();
+        state.bindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_COPY);
+        state.bindBuffer(GL_SHADER_STORAGE_BUFFER, commandLodBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, commandLods.size() * sizeof(GLuint), commandLods.data(), GL_STATIC_DRAW);
+
+        // error of level l + 1 as every mesh sees it, an instance switches once all of its meshes accept the
+        // level, like Model::SelectLod. A mesh without the level never accepts it.
+        lodErrors.assign(GPU_CULL_MAX_LODS, 0.0f);
+        for (unsigned int lod = 1; lod < lodCount; lod++)
+            for (const Mesh &mesh : model.meshes)
+                lodErrors[lod - 1] = std::max(lodErrors[lod - 1], lod <= mesh.lods.size() ? mesh.lods[lod - 1].error
+                                                                                          : std::numeric_limits<float>::max());
+    }
+
+    // culls every instance placed with instances[i] * animation for a frame seen through projection * view
+    // and fills in the draw commands. The previous frame's depth pyramid is used if there is one.
+    void cull(const glm::mat4 &projection, const glm::mat4 &view, const glm::mat4 &animation, const LodSelector &lodSelector)
+    {
+        if (!supported || !model || commandCount == 0)
+            return;
+        GLState &state = GLState::shared();
+        // per-level counters start at zero, once the previous frame's atomics on them are done
+        memoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        GLuint zeros[GPU_CULL_MAX_LODS] = {};
+        state.bindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, transformBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, counterBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, commandLodBuffer);
+
+        Frustum frustum = Frustum::fromMatrix(projection * view);
+        Shader &cullShader = *cullProgram;
+        cullShader.use();
+        cullShader.set(cullInstanceCount, (int)instanceCount);
+        cullShader.set(cullAnimation, animation);
+        cullShader.set(cullDecode, model->PositionDecode());
+        cullShader.set(cullSphere, glm::vec4(model->sphere.center, model->sphere.radius));
+        glUniform4fv(cullFrustumPlanes.location, 6, &frustum.planes[0][0]);
+        cullShader.set(cullLodCount, (int)lodCount);
+        glUniform1fv(cullLodErrors.location, GPU_CULL_MAX_LODS, lodErrors.data());
+        cullShader.set(cullViewPosition, lodSelector.viewPosition);
+        cullShader.set(cullPixelsPerUnit, lodSelector.pixelsPerUnit);
+        cullShader.set(cullMaxPixelError, lodSelector.maxPixelError);
+        cullShader.set(cullOcclusion, hasPyramid);
+        if (hasPyramid)
+        {
+            cullShader.set(cullPreviousViewProjection, previousViewProjection);
+            cullShader.set(cullPyramidSize, glm::vec2((float)pyramidWidth, (float)pyramidHeight));
+            cullShader.set(cullPyramidLevels, (int)pyramidLevels);
+            state.bindTexture(0, GL_TEXTURE_2D, pyramid);
+        }
+        dispatchCompute((instanceCount + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+        memoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        finalizeProgram->use();
+        finalizeProgram->set(finalizeCommandCount, (int)commandCount);
+        dispatchCompute((commandCount + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+        // the commands are read by the multi-draw, the transforms as instance attributes
+        memoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    }
+
+    // submits every mesh of the model with the commands cull fills in, in the pass of its material bucket.
+    // With depthShaders, opaque meshes are also submitted to the depth pre-pass.
+    void submit(RenderQueue &queue, ShaderVariants &shaders, ShaderVariants *depthShaders)
+    {
+        if (!supported || !model)
+            return;
+        for (unsigned int i = 0; i < model->meshes.size(); i++)
+        {
+            Mesh &mesh = model->meshes[i];
+            bool opaque = mesh.Bucket() == MATERIAL_BUCKET_OPAQUE;
+            queue.submitIndirect(opaque ? RENDER_PASS_OPAQUE : RENDER_PASS_ALPHA_MASK, shaders.get(mesh.shaderFeatures), mesh, meshDraws[i]);
+            if (opaque && depthShaders)
+                queue.submitIndirect(RENDER_PASS_DEPTH, depthShaders->get(mesh.shaderFeatures), mesh, meshDraws[i]);
+        }
+    }
+
+    // builds the depth pyramid from depthTexture, the depth of the frame just rendered with viewProjection.
+    // The next cull tests occlusion against it.
+    void buildDepthPyramid(unsigned int depthTexture, int width, int height, const glm::mat4 &viewProjection)
+    {
+        if (!supported)
+            return;
+        resizePyramid(width, height);
+        GLState &state = GLState::shared();
+
+        pyramidCopyProgram->use();
+        state.bindTexture(0, GL_TEXTURE_2D, depthTexture);
+        bindImageTexture(1, pyramid, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        dispatchPyramidLevel(pyramidWidth, pyramidHeight);
+
+        pyramidReduceProgram->use();
+        for (unsigned int level = 1; level < pyramidLevels; level++)
+        {
+            memoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            bindImageTexture(0, pyramid, (GLint)level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            bindImageTexture(1, pyramid, (GLint)level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            dispatchPyramidLevel(std::max(pyramidWidth >> level, 1u), std::max(pyramidHeight >> level, 1u));
+        }
+        memoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        previousViewProjection = viewProjection;
+        hasPyramid = true;
+    }
+
+    // forgets the depth pyramid, the next cull only tests the frustum. Call when frames in between weren't
+    // culled by this culler.
+    void resetHistory()
+    {
+        hasPyramid = false;
+    }
+
+private:
+    bool supported = false;
+    Model *model = nullptr;
+    unsigned int instanceCount = 0;
+    unsigned int lodCount = 1;
+    unsigned int commandCount = 0;
+    std::vector<float> lodErrors;
+    std::vector<IndirectDraw> meshDraws;
+
+    unsigned int instanceBuffer = 0;
+    unsigned int transformBuffer = 0;
+    unsigned int counterBuffer = 0;
+    unsigned int commandBuffer = 0;
+    unsigned int commandLodBuffer = 0;
+
+    unsigned int pyramid = 0;
+    unsigned int pyramidWidth = 0, pyramidHeight = 0, pyramidLevels = 0;
+    int depthWidth = 0, depthHeight = 0;
+    bool hasPyramid = false;
+    glm::mat4 previousViewProjection = glm::mat4(1.0f);
+
+    std::unique_ptr<Shader> cullProgram;
+    std::unique_ptr<Shader> finalizeProgram;
+    std::unique_ptr<Shader> pyramidCopyProgram;
+    std::unique_ptr<Shader> pyramidReduceProgram;
+    UniformHandle<int> cullInstanceCount;
+    UniformHandle<glm::mat4> cullAnimation;
+    UniformHandle<glm::mat4> cullDecode;
+    UniformHandle<glm::vec4> cullSphere;
+    UniformHandle<glm::vec4> cullFrustumPlanes;
+    UniformHandle<int> cullLodCount;
+    UniformHandle<float> cullLodErrors;
+    UniformHandle<glm::vec3> cullViewPosition;
+    UniformHandle<float> cullPixelsPerUnit;
+    UniformHandle<float> cullMaxPixelError;
+    UniformHandle<bool> cullOcclusion;
+    UniformHandle<glm::mat4> cullPreviousViewProjection;
+    UniformHandle<glm::vec2> cullPyramidSize;
+    UniformHandle<int> cullPyramidLevels;
+    UniformHandle<int> finalizeCommandCount;
+
+    PFNGPUCULLERDISPATCHCOMPUTEPROC dispatchCompute = nullptr;
+    PFNGPUCULLERMEMORYBARRIERPROC memoryBarrier = nullptr;
+    PFNGPUCULLERBINDIMAGETEXTUREPROC bindImageTexture = nullptr;
+
+    static unsigned int previousPowerOfTwo(int value)
+    {
+        unsigned int power = 1;
+        while (power * 2 <= (unsigned int)std::max(value, 1))
+            power *= 2;
+        return power;
+    }
+
+    // (re)creates the R32F mip chain for a depth texture of width x height
+    void resizePyramid(int width, int height)
+    {
+        if (pyramid != 0 && width == depthWidth && height == depthHeight)
+            return;
+        depthWidth = width;
+        depthHeight = height;
+        pyramidWidth = previousPowerOfTwo(width);
+        pyramidHeight = previousPowerOfTwo(height);
+        pyramidLevels = 1;
+        while ((std::max(pyramidWidth, pyramidHeight) >> pyramidLevels) > 0)
+            pyramidLevels++;
+
+        GLState &state = GLState::shared();
+        if (pyramid == 0)
+            glGenTextures(1, &pyramid);
+        state.bindTexture(0, GL_TEXTURE_2D, pyramid);
+        for (unsigned int level = 0; level < pyramidLevels; level++)
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_R32F, std::max(pyramidWidth >> level, 1u), std::max(pyramidHeight >> level, 1u),
+                         0, GL_RED, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)pyramidLevels - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        hasPyramid = false;
+    }
+
+    void dispatchPyramidLevel(unsigned int width, unsigned int height)
+    {
+        dispatchCompute((width + GPU_CULL_PYRAMID_GROUP_SIZE - 1) / GPU_CULL_PYRAMID_GROUP_SIZE,
+                        (height + GPU_CULL_PYRAMID_GROUP_SIZE - 1) / GPU_CULL_PYRAMID_GROUP_SIZE, 1);
+    }
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+// GL_TIME_ELAPSED queries in flight per timer, results are read this many frames late so reading never
+// waits for the GPU
+const unsigned int GPU_TIMER_LATENCY = 4;
+
+// GPU time of a span of commands, measured with a ring of GL_TIME_ELAPSED queries (core since GL 3.3).
+// Elapsed queries can't nest, spans timed in the same frame must not overlap.
+class GpuTimer
+{
+public:
+    GpuTimer()
+    {
+        glGenQueries(GPU_TIMER_LATENCY, queries);
+    }
+
+    GpuTimer(const GpuTimer &) = delete;
+    GpuTimer &operator=(const GpuTimer &) = delete;
+
+    ~GpuTimer()
+    {
+        glDeleteQueries(GPU_TIMER_LATENCY, queries);
+    }
+
+    void begin()
+    {
+        // the query about to be reused is the oldest one, collect it first if the GPU is done with it
+        unsigned int slot = next % GPU_TIMER_LATENCY;
+        if (issued[slot])
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &nanoseconds);
+                milliseconds = nanoseconds / 1.0e6;
+                hasResult = true;
+            }
+            // an unfinished query is dropped rather than waited for
+            issued[slot] = false;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        issued[next % GPU_TIMER_LATENCY] = true;
+        next++;
+    }
+
+    // the most recent finished measurement, GPU_TIMER_LATENCY - 1 frames old
+    double lastMilliseconds() const { return milliseconds; }
+    bool ready() const { return hasResult; }
+
+private:
+    GLuint queries[GPU_TIMER_LATENCY];
+    bool issued[GPU_TIMER_LATENCY] = {};
+    unsigned int next = 0;
+    double milliseconds = 0.0;
+    bool hasResult = false;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstring>
+#include <iostream>
+
+// OpenGL core context without a window or display server, made current without any surface
+// (EGL_MESA_platform_surfaceless, falling back to the default display). Everything has to be rendered
+// into framebuffer objects. Works on Mesa's llvmpipe, so it runs on machines without a GPU.
+class HeadlessContext
+{
+public:
+    HeadlessContext() = default;
+    HeadlessContext(const HeadlessContext &) = delete;
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+    ~HeadlessContext()
+    {
+        if (display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+
+    // creates a core profile context of version major.minor and makes it current
+    bool create(int major, int minor)
+    {
+        display = surfacelessDisplay();
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        {
+            std::cout << "ERROR::EGL:: no display, error 0x" << std::hex << eglGetError() << std::dec << std::endl;
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+
+        const EGLint configAttributes[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0)
+        {
+            std::cout << "ERROR::EGL:: no config with desktop OpenGL support" << std::endl;
+            return false;
+        }
+
+        eglBindAPI(EGL_OPENGL_API);
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major,
+            EGL_CONTEXT_MINOR_VERSION, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cout << "ERROR::EGL:: failed to create a surfaceless " << major << "." << minor
+                      << " core context, error 0x" << std::hex << eglGetError() << std::dec << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // loader for gladLoadGLLoader
+    static void *getProcAddress(const char *name)
+    {
+        return (void *)eglGetProcAddress(name);
+    }
+
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+
+    static EGLDisplay surfacelessDisplay()
+    {
+        const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (extensions && std::strstr(extensions, "EGL_MESA_platform_surfaceless"))
+        {
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                    (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (getPlatformDisplay)
+            {
+                EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+                if (display != EGL_NO_DISPLAY)
+                    return display;
+            }
+        }
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef INDEX_FORMAT_H
+#define INDEX_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// a run of triangles drawn with one call, indices are relative to baseVertex
+struct IndexRange {
+    GLsizei count;
+    size_t byteOffset;
+    GLint baseVertex;
+};
+
+// meshes that need more 16-bit ranges (in any level of detail) than this keep 32-bit indices, each range
+// costs a draw call
+const size_t MAX_16BIT_INDEX_RANGES = 4;
+
+// GPU index buffer of a mesh and its levels of detail: 16-bit whenever the vertices referenced by a run of
+// triangles fit in 65536, 32-bit otherwise. All lists share one buffer and one index type.
+struct PackedIndices {
+    GLenum type = GL_UNSIGNED_INT;
+    std::vector<unsigned char> data;
+    // draw ranges of every packed list, byte offsets are into data
+    std::vector<std::vector<IndexRange>> ranges;
+};
+
+// Splits the triangles into consecutive runs whose vertices span at most 65536 indices. Vertices are in
+// first-use order after OptimizeVertexFetch, so a mesh with a few hundred thousand vertices splits into a
+// handful of runs.
+inline std::vector<IndexRange> Split16BitRanges(const std::vector<unsigned int> &indices)
+{
+    std::vector<IndexRange> ranges;
+    size_t start = 0;
+    unsigned int low = ~0u, high = 0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        unsigned int triangleLow = std::min(indices[i], std::min(indices[i + 1], indices[i + 2]));
+        unsigned int triangleHigh = std::max(indices[i], std::max(indices[i + 1], indices[i + 2]));
+        unsigned int newLow = std::min(low, triangleLow);
+        unsigned int newHigh = std::max(high, triangleHigh);
+        if (newHigh - newLow > 0xFFFF)
+        {
+            IndexRange range;
+            range.count = (GLsizei)(i - start);
+            range.byteOffset = start * sizeof(uint16_t);
+            range.baseVertex = (GLint)low;
+            ranges.push_back(range);
+            start = i;
+            newLow = triangleLow;
+            newHigh = triangleHigh;
+            if (newHigh - newLow > 0xFFFF)
+                return std::vector<IndexRange>(); // a single triangle spans too far
+        }
+        low = newLow;
+        high = newHigh;
+    }
+    if (start < indices.size())
+    {
+        IndexRange range;
+        range.count = (GLsizei)(indices.size() - start);
+        range.byteOffset = start * sizeof(uint16_t);
+        range.baseVertex = (GLint)(low == ~0u ? 0 : low);
+        ranges.push_back(range);
+    }
+    return ranges;
+}
+
+inline PackedIndices PackIndices(const std::vector<const std::vector<unsigned int> *> &lists, size_t vertexCount)
+{
+    PackedIndices packed;
+    std::vector<std::vector<IndexRange>> ranges;
+    bool fits16Bit = true;
+    for (const std::vector<unsigned int> *indices : lists)
+    {
+        std::vector<IndexRange> listRanges;
+        if (vertexCount <= 0x10000)
+        {
+            IndexRange whole;
+            whole.count = (GLsizei)indices->size();
+            whole.byteOffset = 0;
+            whole.baseVertex = 0;
+            listRanges.push_back(whole);
+        }
+        else
+        {
+            listRanges = Split16BitRanges(*indices);
+        }
+        if ((listRanges.empty() && !indices->empty()) || listRanges.size() > MAX_16BIT_INDEX_RANGES)
+            fits16Bit = false;
+        ranges.push_back(listRanges);
+    }
+
+    size_t total = 0;
+    for (const std::vector<unsigned int> *indices : lists)
+        total += indices->size();
+
+    if (!fits16Bit)
+    {
+        packed.type = GL_UNSIGNED_INT;
+        packed.data.resize(total * sizeof(uint32_t));
+        size_t first = 0;
+        for (const std::vector<unsigned int> *indices : lists)
+        {
+            if (!indices->empty())
+                std::memcpy(&packed.data[first * sizeof(uint32_t)], indices->data(), indices->size() * sizeof(uint32_t));
+            IndexRange whole;
+            whole.count = (GLsizei)indices->size();
+            whole.byteOffset = first * sizeof(uint32_t);
+            whole.baseVertex = 0;
+            packed.ranges.push_back(std::vector<IndexRange>(1, whole));
+            first += indices->size();
+        }
+        return packed;
+    }
+
+    packed.type = GL_UNSIGNED_SHORT;
+    packed.data.resize(total * sizeof(uint16_t));
+    uint16_t *out = reinterpret_cast<uint16_t *>(packed.data.data());
+    size_t listFirst = 0;
+    for (size_t l = 0; l < lists.size(); l++)
+    {
+        const std::vector<unsigned int> &indices = *lists[l];
+        for (IndexRange &range : ranges[l])
+        {
+            size_t first = range.byteOffset / sizeof(uint16_t);
+            for (size_t i = first; i < first + range.count; i++)
+                out[listFirst + i] = (uint16_t)(indices[i] - range.baseVertex);
+            range.byteOffset += listFirst * sizeof(uint16_t);
+        }
+        listFirst += indices.size();
+    }
+    packed.ranges = ranges;
+    return packed;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// a simplified version of a mesh: its own triangle list over the mesh's vertices, error is the geometric
+// deviation from the full mesh in object space units
+struct MeshLod {
+    std::vector<unsigned int> indices;
+    float error = 0.0f;
+};
+
+// picks levels of detail by how large their error would be on screen
+struct LodSelector {
+    glm::vec3 viewPosition = glm::vec3(0.0f);
+    // pixels covered by one unit at distance one, viewportHeight / (2 tan(fovY / 2))
+    float pixelsPerUnit = 0.0f;
+    // coarsest level whose error stays below this many pixels is chosen
+    float maxPixelError = 1.0f;
+
+    static LodSelector fromView(const glm::vec3 &viewPosition, float fovYDegrees, float viewportHeight, float maxPixelError = 1.0f)
+    {
+        LodSelector selector;
+        selector.viewPosition = viewPosition;
+        selector.pixelsPerUnit = viewportHeight / (2.0f * std::tan(glm::radians(fovYDegrees) * 0.5f));
+        selector.maxPixelError = maxPixelError;
+        return selector;
+    }
+
+    // largest object space error that stays invisible for something at center, drawn with a model matrix
+    // that scales by scale
+    float allowedError(const glm::vec3 &center, float radius, float scale) const
+    {
+        float distance = std::max(glm::length(center - viewPosition) - radius, 1e-3f);
+        return maxPixelError * distance / (pixelsPerUnit * std::max(scale, 1e-6f));
+    }
+};
+
+// largest scale factor of a transform's upper 3x3
+inline float MaxScale(const glm::mat4 &transform)
+{
+    return std::max(glm::length(glm::vec3(transform[0])),
+                    std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+}
+
+#endif
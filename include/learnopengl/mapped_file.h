@@ -0,0 +1,84 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// read-only memory mapping of a whole file. The mapping is released when the object goes out of scope.
+class MappedFile
+{
+public:
+    MappedFile() : data(nullptr), length(0) {}
+
+    explicit MappedFile(const std::string &path) : data(nullptr), length(0)
+    {
+        open(path);
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // maps the file at path, returns false if it does not exist or can't be mapped
+    bool open(const std::string &path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping stays valid after the descriptor is closed
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+        data = static_cast<const unsigned char *>(mapped);
+        length = (size_t)st.st_size;
+        return true;
+    }
+
+    void close()
+    {
+        if (data)
+            munmap(const_cast<unsigned char *>(data), length);
+        data = nullptr;
+        length = 0;
+    }
+
+    bool isOpen() const { return data != nullptr; }
+    const unsigned char *bytes() const { return data; }
+    size_t size() const { return length; }
+
+private:
+    const unsigned char *data;
+    size_t length;
+};
+
+// 64-bit FNV-1a, used to key on-disk caches by content
+inline uint64_t HashBytes(const void *bytes, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(bytes);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+#endif
@@ -6,64 +6,280 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <learnopengl/bounds.h>
+#include <learnopengl/index_format.h>
+#include <learnopengl/lod.h>
+#include <learnopengl/mesh_arena.h>
+#include <learnopengl/render_stats.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/shader_variants.h>
+#include <learnopengl/texture_loader.h>
+#include <learnopengl/vertex_format.h>
 
 #include <string>
 #include <vector>
 using namespace std;
 
-struct Vertex {
-    // position
-    glm::vec3 Position;
-    // normal
-    glm::vec3 Normal;
-    // texCoords
-    glm::vec2 TexCoords;
-    // tangent
-    glm::vec3 Tangent;
-    // bitangent
-    glm::vec3 Bitangent;
-};
-
-
-
 struct Texture {
     unsigned int id;
     string type;
     string path;
 };
 
+// how a material uses alpha, as imported. Opaque materials are drawn by discard-free programs so early
+// depth testing stays on, only alpha-masked ones discard.
+enum MaterialAlpha : uint32_t {
+    MATERIAL_ALPHA_AUTO = 0,   // the format doesn't say (OBJ), decided by the diffuse texture's alpha content
+    MATERIAL_ALPHA_OPAQUE = 1,
+    MATERIAL_ALPHA_MASK = 2
+};
+
+// geometry of a mesh in the GPU format, as MeshArena takes it: packed vertices (PackVertices), the packed
+// indices of every level of detail in one stream (PackIndices) and each level's draw ranges into it. Cooked
+// files store exactly this, vertices and indices then point into the mapped file.
+struct PackedGeometry {
+    PositionQuantization quantization;
+    bool hasTangents = false;
+    const unsigned char *vertices = nullptr;
+    size_t vertexBytes = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    const unsigned char *indices = nullptr;
+    size_t indexBytes = 0;
+    // ranges[level], byte offsets are into indices
+    vector<vector<IndexRange>> ranges;
+    // error of level l + 1, see MeshLod
+    vector<float> lodErrors;
+};
+
+// meshes are drawn in two buckets, opaque first
+enum MaterialBucket {
+    MATERIAL_BUCKET_OPAQUE,
+    MATERIAL_BUCKET_ALPHA_MASK
+};
+
 class Mesh {
 public:
-    // mesh Data
+    // mesh Data, vertices and indices stay empty for meshes built from PackedGeometry
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
 
+    // bounds in the space of the vertices, used for culling
+    AABB bounds;
+    BoundingSphere sphere;
+
+    // world matrix of the node the mesh was imported from, relative to the model. Meshes of static nodes
+    // are usually pre-transformed at import and then have no transform of their own.
+    glm::mat4 transform = glm::mat4(1.0f);
+    bool hasTransform = false;
+
+    // the GPU copy of the vertices is packed, see PackedVertex. quantization maps its positions back.
+    PositionQuantization quantization;
+    // tangents are only uploaded for meshes with a normal map
+    bool hasTangents;
+    // ShaderFeature bits of the program variant that draws this mesh's material
+    unsigned int shaderFeatures;
+    // alpha usage as imported and as resolved by ClassifyAlpha
+    MaterialAlpha alphaMode = MATERIAL_ALPHA_AUTO;
+    bool alphaMasked = false;
+    // simplified levels of detail, lods[0] is level 1 (level 0 is indices). Meshes built from PackedGeometry
+    // only have the errors.
+    vector<MeshLod> lods;
+    // GL_UNSIGNED_SHORT whenever the vertices fit, large meshes then draw one call per range.
+    // lodRanges[level] are the draw ranges of a level in the arena's element buffer, offsets and base
+    // vertices include the mesh's place in the arena.
+    GLenum indexType;
+    vector<vector<IndexRange>> lodRanges;
+
+    // vertices and indices live in a MeshArena block, VAO is the block's (shared with the other meshes in it)
+    MeshAllocation allocation;
     unsigned int VAO;
     std::string glslIdentifierPrefix;
-    // constructor
+    // constructor, positions are quantized inside the bounds of the mesh's own vertices
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        PositionQuantization ownQuantization = PositionQuantization::fromVertices(vertices);
+        init(std::move(vertices), std::move(indices), std::move(textures), ownQuantization);
+    }
+
+    // constructor with a shared quantization box, lets all meshes of a model use one decode matrix,
+    // and optional levels of detail
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, const PositionQuantization &quantization,
+         vector<MeshLod> lods = vector<MeshLod>())
+    {
+        this->lods = std::move(lods);
+        init(std::move(vertices), std::move(indices), std::move(textures), quantization);
+    }
+
+    // constructor from geometry already in the GPU format (see MeshCache), it's uploaded as it is
+    Mesh(const PackedGeometry &geometry, vector<Texture> textures)
+    {
+        this->textures = std::move(textures);
+        quantization = geometry.quantization;
+        hasTangents = geometry.hasTangents;
+        setupFeatures();
+        lods.resize(geometry.lodErrors.size());
+        for (size_t i = 0; i < lods.size(); i++)
+            lods[i].error = geometry.lodErrors[i];
+        indexType = geometry.indexType;
+        upload(geometry.vertices, geometry.vertexBytes, geometry.indices, geometry.indexBytes, geometry.ranges);
+    }
+
+    // the vertices in the GPU format, as setupMesh uploads them
+    vector<unsigned char> PackVertexData() const
+    {
+        return PackVertices(vertices, quantization, hasTangents);
+    }
+
+    // the indices of every level in the GPU format: 16-bit whenever the vertex count allows it, all levels
+    // of detail in one stream
+    PackedIndices PackIndexData() const
+    {
+        vector<const vector<unsigned int> *> lists(1, &indices);
+        for (const MeshLod &lod : lods)
+            lists.push_back(&lod.indices);
+        return PackIndices(lists, vertices.size());
+    }
+
+    // triangles at full detail
+    unsigned long long TriangleCount() const
+    {
+        unsigned long long triangles = 0;
+        for (const IndexRange &range : lodRanges[0])
+            triangles += range.count / 3;
+        return triangles;
+    }
+
+    // resolves alphaMode to opaque or alpha-masked, an AUTO material is masked if its diffuse texture has
+    // transparent texels. Textures have to be uploaded already.
+    void ClassifyAlpha()
+    {
+        alphaMasked = alphaMode == MATERIAL_ALPHA_MASK;
+        if (alphaMode == MATERIAL_ALPHA_AUTO)
+            for (const Texture &texture : textures)
+                if (texture.type == "texture_diffuse" && TextureLoader::hasTransparency(texture.id))
+                    alphaMasked = true;
+        shaderFeatures = alphaMasked ? (shaderFeatures | SHADER_ALPHA_MASK) : (shaderFeatures & ~SHADER_ALPHA_MASK);
+    }
+
+    MaterialBucket Bucket() const
+    {
+        return alphaMasked ? MATERIAL_BUCKET_ALPHA_MASK : MATERIAL_BUCKET_OPAQUE;
+    }
+
+    unsigned int LodCount() const
+    {
+        return (unsigned int)lods.size() + 1;
+    }
+
+    // object space error of a level, 0 for the full mesh
+    float LodError(unsigned int lod) const
+    {
+        return lod == 0 || lods.empty() ? 0.0f : lods[std::min<size_t>(lod, lods.size()) - 1].error;
+    }
+
+    // coarsest level whose error is at most allowedError
+    unsigned int SelectLod(float allowedError) const
+    {
+        unsigned int lod = 0;
+        while (lod < lods.size() && lods[lod].error <= allowedError)
+            lod++;
+        return lod;
+    }
+
+    // computes bounds and sphere from the vertex positions
+    void ComputeBounds()
+    {
+        bounds = AABB();
+        for (const Vertex &vertex : vertices)
+            bounds.expand(vertex.Position);
+        sphere.center = bounds.center();
+        sphere.radius = 0.0f;
+        for (const Vertex &vertex : vertices)
+            sphere.radius = std::max(sphere.radius, glm::length(vertex.Position - sphere.center));
+    }
+
+    // prefix of the sampler uniform names, e.g. "material." for material.texture_diffuse1
+    void SetShaderTextureNamePrefix(const std::string &prefix)
+    {
+        glslIdentifierPrefix = prefix;
+        samplerLocations.clear();
+    }
+
+    // the steps of drawing the mesh, for callers that track what is bound already (see RenderQueue)
+
+    // binds the material textures and points the samplers of shader at them, shader has to be in use
+    void BindMaterial(Shader &shader)
+    {
+        bindTextures(shader);
+    }
+
+    // draws level of detail lod, VAO has to be bound
+    void DrawBound(unsigned int lod)
+    {
+        for (const IndexRange &range : lodRanges[std::min<size_t>(lod, lods.size())])
+        {
+            if (range.baseVertex == 0)
+                glDrawElements(GL_TRIANGLES, range.count, indexType, (void*)range.byteOffset);
+            else
+                glDrawElementsBaseVertex(GL_TRIANGLES, range.count, indexType, (void*)range.byteOffset, range.baseVertex);
+            RenderStats::frame().addDraw(range.count / 3);
+        }
+    }
+
+    // attaches a buffer of glm::mat4 model matrices to the bound VAO as per-instance attributes 5-8 (one vec4
+    // column each), instance 0 is read at byteOffset
+    void AttachInstances(unsigned int instanceVBO, size_t byteOffset)
+    {
+        GLState::shared().bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(5 + column);
+            glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(byteOffset + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(5 + column, 1);
+        }
+    }
+
+private:
+    void init(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, const PositionQuantization &quantization)
+    {
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->quantization = quantization;
+        hasTangents = false;
+        for (const Texture &texture : this->textures)
+            hasTangents = hasTangents || texture.type == "texture_normal";
+        setupFeatures();
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    void setupFeatures()
     {
-        // bind appropriate textures
+        shaderFeatures = 0;
+        for (const Texture &texture : textures)
+            if (texture.type == "texture_specular")
+                shaderFeatures |= SHADER_HAS_SPECULAR;
+    }
+
+    // sampler locations of textures[i], resolved once per program on its first draw of this mesh
+    vector<pair<unsigned int, vector<GLint>>> samplerLocations;
+
+    const vector<GLint> &samplerLocationsFor(const Shader &shader)
+    {
+        for (const auto &entry : samplerLocations)
+            if (entry.first == shader.ID)
+                return entry.second;
+
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
+        vector<GLint> locations;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -75,67 +291,50 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
             else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            locations.push_back(shader.getUniformLocation(glslIdentifierPrefix + name + number));
         }
-
-
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
-
-        // reset svih tekstura na default
+        samplerLocations.emplace_back(shader.ID, std::move(locations));
+        return samplerLocations.back().second;
     }
 
-private:
-    // render data
-    unsigned int VBO, EBO;
+    // binds every texture to its own unit and points the matching sampler at it
+    void bindTextures(Shader &shader)
+    {
+        const vector<GLint> &locations = samplerLocationsFor(shader);
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            // set the sampler to the texture unit
+            glUniform1i(locations[i], i);
+            // and bind the texture to it, the unit is only activated if its binding changes
+            GLState::shared().bindTexture(i, GL_TEXTURE_2D, textures[i].id);
+        }
+    }
 
-    // initializes all the buffer objects/arrays
+    // packs the vertices and indices and copies them into the mesh arena
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+        // the GPU gets the packed vertex format, a quarter to a third of the size of Vertex
+        vector<unsigned char> packed = PackVertexData();
+        PackedIndices packedIndices = PackIndexData();
+        indexType = packedIndices.type;
+        upload(packed.data(), packed.size(), packedIndices.data.data(), packedIndices.data.size(), packedIndices.ranges);
+    }
+
+    // copies packed vertices and indices into the mesh arena, ranges are every level's draw ranges into indices
+    void upload(const unsigned char *packedVertices, size_t vertexBytes, const unsigned char *packedIndices, size_t indexBytes,
+                const vector<vector<IndexRange>> &ranges)
+    {
+        allocation = MeshArena::shared().allocate(hasTangents, packedVertices, vertexBytes, packedIndices, indexBytes);
+        VAO = allocation.vertexArray;
+        lodRanges = ranges;
+        for (vector<IndexRange> &ranges : lodRanges)
+        {
+            for (IndexRange &range : ranges)
+            {
+                range.byteOffset += allocation.indexByteOffset;
+                range.baseVertex += allocation.baseVertex;
+            }
+        }
     }
 };
 #endif
\ No newline at end of file
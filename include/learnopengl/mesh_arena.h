@@ -0,0 +1,148 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/vertex_format.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// size of a block's vertex and index buffer, a mesh that doesn't fit into an empty block gets one of its own
+const size_t MESH_ARENA_VERTEX_BLOCK_SIZE = 32u << 20;
+const size_t MESH_ARENA_INDEX_BLOCK_SIZE = 16u << 20;
+
+// where the vertices and indices of a mesh live. Indices are relative to baseVertex, byte offsets of index
+// ranges are relative to indexByteOffset.
+struct MeshAllocation {
+    unsigned int block = 0;
+    unsigned int vertexArray = 0;
+    GLint baseVertex = 0;
+    size_t indexByteOffset = 0;
+};
+
+// Sub-allocates the vertex and index data of static meshes from a few large buffers. Every block holds
+// meshes of one packed vertex format (with or without tangents) and has one VAO, so meshes of a block draw
+// without switching vertex arrays, at their baseVertex and index offset. Allocations live as long as the
+// program, meshes are never unloaded.
+class MeshArena
+{
+public:
+    static MeshArena &shared()
+    {
+        static MeshArena arena;
+        return arena;
+    }
+
+    MeshArena(const MeshArena &) = delete;
+    MeshArena &operator=(const MeshArena &) = delete;
+
+    // copies vertexBytes of packed vertices (PackVertices) and indexBytes of indices (PackIndices) into a
+    // block of their format
+    MeshAllocation allocate(bool withTangents, const unsigned char *vertices, size_t vertexBytes, const unsigned char *indices,
+                            size_t indexBytes)
+    {
+        size_t stride = withTangents ? PACKED_TANGENT_VERTEX_SIZE : PACKED_VERTEX_SIZE;
+        unsigned int index = findBlock(withTangents, vertexBytes, indexBytes);
+        Block &block = blocks[index];
+        // index offsets stay 4-byte aligned whatever the index type of the previous mesh was
+        block.indexUsed = (block.indexUsed + 3) & ~(size_t)3;
+
+        MeshAllocation allocation;
+        allocation.block = index;
+        allocation.vertexArray = block.vertexArray;
+        allocation.baseVertex = (GLint)(block.vertexUsed / stride);
+        allocation.indexByteOffset = block.indexUsed;
+
+        GLState &state = GLState::shared();
+        state.bindBuffer(GL_ARRAY_BUFFER, block.vertexBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, block.vertexUsed, vertexBytes, vertices);
+        // the element buffer is bound through the block's VAO
+        state.bindVertexArray(block.vertexArray);
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.indexBuffer);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, block.indexUsed, indexBytes, indices);
+        state.bindVertexArray(0);
+
+        block.vertexUsed += vertexBytes;
+        block.indexUsed += indexBytes;
+        return allocation;
+    }
+
+    // a second VAO of the allocation's block for instanced draws, it also has the per-instance attributes
+    // that Mesh::AttachInstances points at an instance buffer
+    unsigned int instancedVertexArray(const MeshAllocation &allocation)
+    {
+        Block &block = blocks[allocation.block];
+        if (block.instancedVertexArray == 0)
+        {
+            block.instancedVertexArray = createVertexArray(block);
+            GLState::shared().bindVertexArray(0);
+        }
+        return block.instancedVertexArray;
+    }
+
+    size_t blockCount() const { return blocks.size(); }
+
+private:
+    struct Block {
+        bool withTangents;
+        unsigned int vertexArray;
+        unsigned int instancedVertexArray;
+        unsigned int vertexBuffer;
+        unsigned int indexBuffer;
+        size_t vertexCapacity, vertexUsed;
+        size_t indexCapacity, indexUsed;
+    };
+
+    std::vector<Block> blocks;
+
+    MeshArena() = default;
+
+    unsigned int findBlock(bool withTangents, size_t vertexBytes, size_t indexBytes)
+    {
+        for (unsigned int i = 0; i < blocks.size(); i++)
+        {
+            const Block &block = blocks[i];
+            if (block.withTangents == withTangents && block.vertexUsed + vertexBytes <= block.vertexCapacity &&
+                ((block.indexUsed + 3) & ~(size_t)3) + indexBytes <= block.indexCapacity)
+                return i;
+        }
+
+        size_t stride = withTangents ? PACKED_TANGENT_VERTEX_SIZE : PACKED_VERTEX_SIZE;
+        Block block;
+        block.withTangents = withTangents;
+        block.vertexCapacity = std::max(MESH_ARENA_VERTEX_BLOCK_SIZE / stride * stride, vertexBytes);
+        block.indexCapacity = std::max(MESH_ARENA_INDEX_BLOCK_SIZE, indexBytes);
+        block.vertexUsed = 0;
+        block.indexUsed = 0;
+        block.instancedVertexArray = 0;
+
+        GLState &state = GLState::shared();
+        glGenBuffers(1, &block.vertexBuffer);
+        state.bindBuffer(GL_ARRAY_BUFFER, block.vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, block.vertexCapacity, NULL, GL_STATIC_DRAW);
+        glGenBuffers(1, &block.indexBuffer);
+        block.vertexArray = createVertexArray(block);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, block.indexCapacity, NULL, GL_STATIC_DRAW);
+        state.bindVertexArray(0);
+        blocks.push_back(block);
+        return (unsigned int)blocks.size() - 1;
+    }
+
+    // VAO over the block's buffers in its vertex format, left bound
+    static unsigned int createVertexArray(const Block &block)
+    {
+        GLState &state = GLState::shared();
+        unsigned int vertexArray;
+        glGenVertexArrays(1, &vertexArray);
+        state.bindVertexArray(vertexArray);
+        state.bindBuffer(GL_ARRAY_BUFFER, block.vertexBuffer);
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.indexBuffer);
+        SetupPackedVertexAttributes(block.withTangents);
+        return vertexArray;
+    }
+};
+
+#endif
@@ -0,0 +1,300 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/asset_pack.h>
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mesh.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// On-disk cache of fully imported models ("cooked" meshes). A cooked file sits next to its source as
+// <source>.cooked and stores every Mesh in the GPU format (PackedGeometry) with its texture references, so
+// a warm start maps the file and hands the vertex and index bytes straight to glBufferSubData instead of
+// running Assimp and packing. Sources are read from the AssetPack when it has them, cooked files are never
+// packed (AssetPack::isCacheFile) and always read from and written to disk.
+//
+// layout (native endianness, every section 4-byte aligned):
+//   header   : magic, version, sizeof(PackedVertex), import flags, pre-transform flag, source hash, mesh count
+//   per mesh : has tangents, index type, level count, texture count, has transform, alpha mode, transform,
+//              bounds (AABB, sphere), position quantization, vertex bytes, index bytes (64-bit), packed
+//              vertices, packed indices,
+//              per level: error, range count, per range: index count, byte offset (64-bit), base vertex,
+//              per texture: type length, type, path length, path (strings padded to 4 bytes)
+
+// bump whenever the import pipeline or the layout above changes, old cache files are then re-cooked
+const uint32_t MESH_CACHE_MAGIC = 0x434D4752; // "RGMC"
+const uint32_t MESH_CACHE_VERSION = 8;
+
+struct CookedTexture {
+    string type;
+    string path;
+};
+
+// a mesh as stored in the cache, the geometry's vertex and index pointers point into the mapped file
+struct CookedMesh {
+    glm::mat4 transform;
+    bool hasTransform;
+    MaterialAlpha alphaMode;
+    AABB bounds;
+    BoundingSphere sphere;
+    PackedGeometry geometry;
+    vector<CookedTexture> textures;
+};
+
+class MeshCache
+{
+public:
+    static string cachePath(const string &sourcePath)
+    {
+        return sourcePath + ".cooked";
+    }
+
+    // hashes the source file together with its same-named .mtl/.bin sidecar (OBJ materials, glTF buffers),
+    // returns 0 if the source can't be read
+    static uint64_t sourceHash(const string &sourcePath)
+    {
+        AssetFile source(sourcePath);
+        if (!source.isOpen())
+            return 0;
+        uint64_t hash = HashBytes(source.bytes(), source.size());
+        string stem = sourcePath.substr(0, sourcePath.find_last_of('.'));
+        const char *sidecars[] = {".mtl", ".bin"};
+        for (const char *extension : sidecars)
+        {
+            AssetFile sidecar(stem + extension);
+            if (sidecar.isOpen())
+                hash = HashBytes(sidecar.bytes(), sidecar.size(), hash);
+        }
+        return hash;
+    }
+
+    // maps the cooked file of sourcePath and checks that it was cooked from the same source with the same
+    // import flags and pre-transform setting by this version of the importer
+    bool open(const string &sourcePath, uint64_t hash, uint32_t importFlags, bool preTransform)
+    {
+        cooked.clear();
+        if (hash == 0 || !file.open(cachePath(sourcePath)))
+            return false;
+
+        offset = 0;
+        uint32_t magic, version, vertexSize, flags, preTransformed, meshCount;
+        uint64_t storedHash;
+        if (!read(magic) || !read(version) || !read(vertexSize) || !read(flags) || !read(preTransformed) ||
+            !read(storedHash) || !read(meshCount))
+            return fail();
+        if (magic != MESH_CACHE_MAGIC || version != MESH_CACHE_VERSION || vertexSize != sizeof(PackedVertex) ||
+            flags != importFlags || preTransformed != (uint32_t)preTransform || storedHash != hash)
+            return fail();
+
+        cooked.resize(meshCount);
+        for (CookedMesh &mesh : cooked)
+        {
+            PackedGeometry &geometry = mesh.geometry;
+            uint32_t hasTangents, indexType, levelCount, textureCount, hasTransform, alphaMode;
+            uint64_t vertexBytes, indexBytes;
+            if (!read(hasTangents) || !read(indexType) || !read(levelCount) || !read(textureCount) || !read(hasTransform) ||
+                !read(alphaMode) || !read(mesh.transform) || !read(mesh.bounds) || !read(mesh.sphere) ||
+                !read(geometry.quantization) || !read(vertexBytes) || !read(indexBytes))
+                return fail();
+            mesh.hasTransform = hasTransform != 0;
+            if (alphaMode > MATERIAL_ALPHA_MASK || (indexType != GL_UNSIGNED_SHORT && indexType != GL_UNSIGNED_INT) ||
+                levelCount == 0 || vertexBytes > file.size() || indexBytes > file.size())
+                return fail();
+            mesh.alphaMode = (MaterialAlpha)alphaMode;
+            geometry.hasTangents = hasTangents != 0;
+            geometry.indexType = indexType;
+            geometry.vertexBytes = (size_t)vertexBytes;
+            geometry.indexBytes = (size_t)indexBytes;
+            size_t stride = geometry.hasTangents ? PACKED_TANGENT_VERTEX_SIZE : PACKED_VERTEX_SIZE;
+            size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+            if (geometry.vertexBytes % stride != 0 || geometry.indexBytes % indexSize != 0)
+                return fail();
+            geometry.vertices = take(geometry.vertexBytes);
+            geometry.indices = take(geometry.indexBytes);
+            if (!geometry.vertices || !geometry.indices)
+                return fail();
+            geometry.ranges.resize(levelCount);
+            geometry.lodErrors.resize(levelCount - 1);
+            for (uint32_t level = 0; level < levelCount; level++)
+            {
+                float error;
+                uint32_t rangeCount;
+                if (!read(error) || !read(rangeCount) || rangeCount > file.size())
+                    return fail();
+                if (level > 0)
+                    geometry.lodErrors[level - 1] = error;
+                geometry.ranges[level].resize(rangeCount);
+                for (IndexRange &range : geometry.ranges[level])
+                {
+                    uint32_t count;
+                    uint64_t byteOffset;
+                    int32_t baseVertex;
+                    if (!read(count) || !read(byteOffset) || !read(baseVertex))
+                        return fail();
+                    // every range lies inside the index bytes, base vertices inside the vertices
+                    if (byteOffset > geometry.indexBytes || count > (geometry.indexBytes - byteOffset) / indexSize ||
+                        byteOffset % indexSize != 0 || baseVertex < 0 || (size_t)baseVertex > geometry.vertexBytes / stride)
+                        return fail();
+                    range.count = (GLsizei)count;
+                    range.byteOffset = (size_t)byteOffset;
+                    range.baseVertex = (GLint)baseVertex;
+                }
+            }
+            mesh.textures.resize(textureCount);
+            for (CookedTexture &texture : mesh.textures)
+            {
+                if (!readString(texture.type) || !readString(texture.path))
+                    return fail();
+            }
+        }
+        return true;
+    }
+
+    const vector<CookedMesh> &meshes() const
+    {
+        return cooked;
+    }
+
+    // writes the imported meshes of sourcePath to its cooked file. The file is written under a temporary
+    // name and renamed so a crash mid-write never leaves a truncated cache behind.
+    static bool write(const string &sourcePath, uint64_t hash, uint32_t importFlags, bool preTransform,
+                      const vector<Mesh> &meshes)
+    {
+        if (hash == 0)
+            return false;
+        string path = cachePath(sourcePath);
+        string tmpPath = path + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            uint32_t vertexSize = sizeof(PackedVertex);
+            uint32_t meshCount = (uint32_t)meshes.size();
+            write(out, MESH_CACHE_MAGIC);
+            write(out, MESH_CACHE_VERSION);
+            write(out, vertexSize);
+            write(out, importFlags);
+            write(out, (uint32_t)preTransform);
+            write(out, hash);
+            write(out, meshCount);
+            for (const Mesh &mesh : meshes)
+            {
+                // the same bytes setupMesh uploaded
+                vector<unsigned char> vertices = mesh.PackVertexData();
+                PackedIndices indices = mesh.PackIndexData();
+                write(out, (uint32_t)mesh.hasTangents);
+                write(out, (uint32_t)indices.type);
+                write(out, (uint32_t)indices.ranges.size());
+                write(out, (uint32_t)mesh.textures.size());
+                write(out, (uint32_t)mesh.hasTransform);
+                write(out, (uint32_t)mesh.alphaMode);
+                write(out, mesh.transform);
+                write(out, mesh.bounds);
+                write(out, mesh.sphere);
+                write(out, mesh.quantization);
+                write(out, (uint64_t)vertices.size());
+                write(out, (uint64_t)indices.data.size());
+                writeBytes(out, vertices.data(), vertices.size());
+                writeBytes(out, indices.data.data(), indices.data.size());
+                for (size_t level = 0; level < indices.ranges.size(); level++)
+                {
+                    write(out, mesh.LodError((unsigned int)level));
+                    write(out, (uint32_t)indices.ranges[level].size());
+                    for (const IndexRange &range : indices.ranges[level])
+                    {
+                        write(out, (uint32_t)range.count);
+                        write(out, (uint64_t)range.byteOffset);
+                        write(out, (int32_t)range.baseVertex);
+                    }
+                }
+                for (const Texture &texture : mesh.textures)
+                {
+                    writeString(out, texture.type);
+                    writeString(out, texture.path);
+                }
+            }
+            if (!out)
+            {
+                out.close();
+                std::remove(tmpPath.c_str());
+                return false;
+            }
+        }
+        return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    // mapped from disk even if an older pack has a copy, see AssetPack::isCacheFile
+    MappedFile file;
+    size_t offset = 0;
+    vector<CookedMesh> cooked;
+
+    bool fail()
+    {
+        cooked.clear();
+        file.close();
+        return false;
+    }
+
+    // returns a pointer to the next size bytes of the mapping (4-byte aligned), or nullptr past the end
+    const unsigned char *take(size_t size)
+    {
+        if (size > file.size() - offset)
+            return nullptr;
+        const unsigned char *p = file.bytes() + offset;
+        offset += (size + 3) & ~(size_t)3;
+        if (offset > file.size())
+            offset = file.size();
+        return p;
+    }
+
+    template<typename T>
+    bool read(T &value)
+    {
+        const unsigned char *p = take(sizeof(T));
+        if (!p)
+            return false;
+        std::memcpy(&value, p, sizeof(T));
+        return true;
+    }
+
+    bool readString(string &value)
+    {
+        uint32_t length;
+        if (!read(length))
+            return false;
+        const unsigned char *p = take(length);
+        if (!p)
+            return false;
+        value.assign(reinterpret_cast<const char *>(p), length);
+        return true;
+    }
+
+    template<typename T>
+    static void write(std::ofstream &out, const T &value)
+    {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    // size bytes padded to 4
+    static void writeBytes(std::ofstream &out, const void *bytes, size_t size)
+    {
+        static const char padding[4] = {0, 0, 0, 0};
+        out.write(reinterpret_cast<const char *>(bytes), size);
+        out.write(padding, (4 - size % 4) % 4);
+    }
+
+    static void writeString(std::ofstream &out, const string &value)
+    {
+        write(out, (uint32_t)value.size());
+        writeBytes(out, value.data(), value.size());
+    }
+};
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/vertex_format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Import-time optimization of indexed triangle lists, run on every mesh before it's cooked:
+//   1. WeldVertices        merges bitwise identical vertices (Assimp emits one vertex per face corner)
+//   2. OptimizeVertexCache reorders triangles for the post-transform cache (Forsyth's linear-speed algorithm)
+//   3. OptimizeOverdraw    reorders clusters of triangles front to back (outward facing first)
+//   4. OptimizeVertexFetch renumbers vertices in order of first use, so vertex fetch streams through memory
+
+// post-transform cache efficiency: ACMR is transformed vertices per triangle (0.5 is ideal for big grid-like
+// meshes, 3 is the worst), ATVR is transformed vertices per unique vertex (1 is ideal)
+struct VertexCacheStats {
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+// simulates a FIFO post-transform cache of cacheSize entries
+inline VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize = 16)
+{
+    VertexCacheStats stats;
+    if (indices.empty() || vertexCount == 0)
+        return stats;
+    // time stamp of the moment a vertex entered the cache, it's still cached while less than cacheSize
+    // misses happened since
+    std::vector<unsigned int> cachedAt(vertexCount, 0);
+    unsigned int misses = 0;
+    for (unsigned int index : indices)
+    {
+        if (cachedAt[index] == 0 || misses - cachedAt[index] + 1 > cacheSize)
+        {
+            misses++;
+            cachedAt[index] = misses;
+        }
+    }
+    stats.acmr = (float)misses / (indices.size() / 3);
+    std::vector<bool> used(vertexCount, false);
+    size_t unique = 0;
+    for (unsigned int index : indices)
+    {
+        if (!used[index])
+        {
+            used[index] = true;
+            unique++;
+        }
+    }
+    stats.atvr = (float)misses / unique;
+    return stats;
+}
+
+struct VertexHasher {
+    size_t operator()(const Vertex &vertex) const
+    {
+        return (size_t)HashBytes(&vertex, sizeof(Vertex));
+    }
+};
+
+struct VertexEqual {
+    bool operator()(const Vertex &a, const Vertex &b) const
+    {
+        return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+};
+
+// merges vertices with identical attributes, indices are rewritten to the surviving copy
+inline void WeldVertices(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    std::unordered_map<Vertex, unsigned int, VertexHasher, VertexEqual> unique;
+    unique.reserve(vertices.size());
+    std::vector<unsigned int> remap(vertices.size());
+    std::vector<Vertex> welded;
+    welded.reserve(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        auto inserted = unique.insert(std::make_pair(vertices[i], (unsigned int)welded.size()));
+        if (inserted.second)
+            welded.push_back(vertices[i]);
+        remap[i] = inserted.first->second;
+    }
+    for (unsigned int &index : indices)
+        index = remap[index];
+    vertices.swap(welded);
+}
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation": greedily emits the triangle whose vertices score
+// highest, scores favour vertices recently used (in a simulated LRU cache) and vertices with few
+// triangles left, so that isolated vertices are finished off early.
+inline void OptimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount)
+{
+    const int CACHE_SIZE = 32;
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    auto vertexScore = [&](int cachePosition, unsigned int remaining) {
+        if (remaining == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+                score = LAST_TRIANGLE_SCORE;
+            else
+                score = std::pow(1.0f - (float)(cachePosition - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+        return score + VALENCE_BOOST_SCALE * std::pow((float)remaining, -VALENCE_BOOST_POWER);
+    };
+
+    // triangles adjacent to every vertex, in one array with per-vertex offsets
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices)
+        remaining[index]++;
+    std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(-1, remaining[v]);
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+    std::vector<bool> emitted(triangleCount, false);
+
+    std::vector<unsigned int> cache, nextCache;
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    size_t scanCursor = 0;
+    long best = -1;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+    {
+        if (best < 0)
+        {
+            // nothing adjacent to the cache is left, continue with the next untouched triangle
+            while (emitted[scanCursor])
+                scanCursor++;
+            best = (long)scanCursor;
+        }
+        size_t t = (size_t)best;
+        emitted[t] = true;
+        const unsigned int *triangle = &indices[t * 3];
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // the emitted triangle's vertices move to the front of the cache
+        nextCache.assign(triangle, triangle + 3);
+        for (unsigned int v : cache)
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                nextCache.push_back(v);
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = triangle[k];
+            unsigned int *begin = &adjacency[adjacencyOffset[v]];
+            unsigned int *end = begin + remaining[v];
+            *std::find(begin, end, (unsigned int)t) = *(end - 1);
+            remaining[v]--;
+        }
+
+        // rescore everything that was in the cache, including vertices that just fell out of it
+        for (size_t i = 0; i < nextCache.size(); i++)
+        {
+            unsigned int v = nextCache[i];
+            cachePosition[v] = i < (size_t)CACHE_SIZE ? (int)i : -1;
+            score[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+        float bestScore = -1.0f;
+        best = -1;
+        for (size_t i = 0; i < nextCache.size(); i++)
+        {
+            unsigned int v = nextCache[i];
+            for (unsigned int a = adjacencyOffset[v]; a < adjacencyOffset[v] + remaining[v]; a++)
+            {
+                unsigned int other = adjacency[a];
+                const unsigned int *o = &indices[other * 3];
+                triangleScore[other] = score[o[0]] + score[o[1]] + score[o[2]];
+                if (triangleScore[other] > bestScore)
+                {
+                    bestScore = triangleScore[other];
+                    best = other;
+                }
+            }
+        }
+        if (nextCache.size() > (size_t)CACHE_SIZE)
+            nextCache.resize(CACHE_SIZE);
+        cache.swap(nextCache);
+    }
+    indices.swap(output);
+}
+
+// Splits the cache-ordered triangles into clusters at the points where the cache restarts anyway (all
+// three vertices miss), then sorts the clusters so that those facing away from the mesh center, which
+// tend to be in front from any view, are drawn first (Sander et al., "Fast Triangle Reordering for
+// Vertex Locality and Reduced Overdraw"). Reordering at restart points keeps the cache efficiency.
+inline void OptimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices, unsigned int cacheSize = 16)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return;
+
+    std::vector<size_t> clusterStart;
+    std::vector<unsigned int> cachedAt(vertices.size(), 0);
+    unsigned int misses = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        int triangleMisses = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int index = indices[t * 3 + k];
+            if (cachedAt[index] == 0 || misses - cachedAt[index] + 1 > cacheSize)
+            {
+                misses++;
+                cachedAt[index] = misses;
+                triangleMisses++;
+            }
+        }
+        if (t == 0 || triangleMisses == 3)
+            clusterStart.push_back(t);
+    }
+    clusterStart.push_back(triangleCount);
+    size_t clusterCount = clusterStart.size() - 1;
+    if (clusterCount < 2)
+        return;
+
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> clusterCenter(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+    std::vector<float> clusterArea(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++)
+        {
+            const glm::vec3 &a = vertices[indices[t * 3]].Position;
+            const glm::vec3 &b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &d = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 normal = glm::cross(b - a, d - a);
+            float area = glm::length(normal);
+            glm::vec3 center = (a + b + d) / 3.0f;
+            clusterCenter[c] += center * area;
+            clusterNormal[c] += normal;
+            clusterArea[c] += area;
+            meshCenter += center * area;
+            meshArea += area;
+        }
+    }
+    if (meshArea <= 0.0f)
+        return;
+    meshCenter /= meshArea;
+
+    std::vector<float> sortKey(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        if (clusterArea[c] <= 0.0f)
+            continue;
+        glm::vec3 center = clusterCenter[c] / clusterArea[c];
+        float normalLength = glm::length(clusterNormal[c]);
+        if (normalLength > 0.0f)
+            sortKey[c] = glm::dot(center - meshCenter, clusterNormal[c] / normalLength);
+    }
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (size_t c : order)
+        output.insert(output.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+    indices.swap(output);
+}
+
+// renumbers vertices in the order the index buffer first references them, unreferenced vertices are dropped
+inline void OptimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    const unsigned int UNUSED = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), UNUSED);
+    std::vector<Vertex> ordered;
+    ordered.reserve(vertices.size());
+    for (unsigned int &index : indices)
+    {
+        if (remap[index] == UNUSED)
+        {
+            remap[index] = (unsigned int)ordered.size();
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(ordered);
+}
+
+struct MeshOptimizationReport {
+    size_t verticesBefore = 0;
+    size_t verticesAfter = 0;
+    VertexCacheStats before;
+    VertexCacheStats after;
+};
+
+// runs the whole pipeline on one mesh
+inline MeshOptimizationReport OptimizeMesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    MeshOptimizationReport report;
+    report.verticesBefore = vertices.size();
+    report.before = AnalyzeVertexCache(indices, vertices.size());
+    WeldVertices(vertices, indices);
+    OptimizeVertexCache(indices, vertices.size());
+    OptimizeOverdraw(indices, vertices);
+    OptimizeVertexFetch(vertices, indices);
+    report.verticesAfter = vertices.size();
+    report.after = AnalyzeVertexCache(indices, vertices.size());
+    return report;
+}
+
+#endif
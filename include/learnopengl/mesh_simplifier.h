@@ -0,0 +1,289 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/lod.h>
+#include <learnopengl/mesh_optimizer.h>
+#include <learnopengl/vertex_format.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// levels generated below the full mesh, every level targets half the triangles of the previous one
+const unsigned int MAX_MESH_LODS = 3;
+// simplification stops when the error would exceed this fraction of the mesh's bounding box diagonal
+const float LOD_MAX_RELATIVE_ERROR = 0.02f;
+
+// symmetric 4x4 error quadric (Garland & Heckbert), sum of squared distances to a set of planes
+struct Quadric {
+    double a[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; // xx xy xz xw yy yz yw zz zw ww
+
+    static Quadric fromPlane(const glm::vec3 &n, float d)
+    {
+        Quadric q;
+        double x = n.x, y = n.y, z = n.z, w = d;
+        q.a[0] = x * x; q.a[1] = x * y; q.a[2] = x * z; q.a[3] = x * w;
+        q.a[4] = y * y; q.a[5] = y * z; q.a[6] = y * w;
+        q.a[7] = z * z; q.a[8] = z * w;
+        q.a[9] = w * w;
+        return q;
+    }
+
+    void add(const Quadric &other)
+    {
+        for (int i = 0; i < 10; i++)
+            a[i] += other.a[i];
+    }
+
+    double error(const glm::vec3 &v) const
+    {
+        double x = v.x, y = v.y, z = v.z;
+        double result = a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+                      + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+                      + a[7] * z * z + 2 * a[8] * z
+                      + a[9];
+        return result > 0.0 ? result : 0.0;
+    }
+};
+
+// Simplifies an indexed triangle list by half-edge collapses ordered by quadric error, until at most
+// targetIndexCount indices remain or the next collapse would move the surface by more than maxError.
+// Vertices are never moved or added, the result indexes into the same vertex array. Vertices on mesh
+// borders and attribute seams (several vertices sharing a position) are kept so the outline and the
+// texture mapping stay intact. resultError receives the largest error of an applied collapse.
+inline std::vector<unsigned int> SimplifyMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                                              size_t targetIndexCount, float maxError, float &resultError)
+{
+    resultError = 0.0f;
+    std::vector<unsigned int> result(indices);
+    size_t triangleCount = indices.size() / 3;
+
+    // vertices sharing a position collapse together
+    struct PositionHash {
+        size_t operator()(const glm::vec3 &p) const { return (size_t)HashBytes(&p, sizeof(p)); }
+    };
+    struct PositionEqual {
+        bool operator()(const glm::vec3 &a, const glm::vec3 &b) const { return std::memcmp(&a, &b, sizeof(a)) == 0; }
+    };
+    std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual> positionIds;
+    std::vector<unsigned int> positionOf(vertices.size());
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> vertexCount;
+    for (size_t v = 0; v < vertices.size(); v++)
+    {
+        auto inserted = positionIds.insert(std::make_pair(vertices[v].Position, (unsigned int)positions.size()));
+        if (inserted.second)
+        {
+            positions.push_back(vertices[v].Position);
+            vertexCount.push_back(0);
+        }
+        positionOf[v] = inserted.first->second;
+        vertexCount[positionOf[v]]++;
+    }
+    size_t positionCount = positions.size();
+
+    // seams and borders are locked, a border edge belongs to one triangle only
+    std::vector<bool> locked(positionCount, false);
+    for (size_t p = 0; p < positionCount; p++)
+        locked[p] = vertexCount[p] > 1;
+    std::unordered_map<uint64_t, int> edgeUse;
+    auto edgeKey = [](unsigned int a, unsigned int b) {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    };
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            edgeUse[edgeKey(positionOf[indices[t * 3 + k]], positionOf[indices[t * 3 + (k + 1) % 3]])]++;
+    for (const auto &edge : edgeUse)
+    {
+        if (edge.second == 1)
+        {
+            locked[(unsigned int)(edge.first >> 32)] = true;
+            locked[(unsigned int)(edge.first & 0xFFFFFFFFu)] = true;
+        }
+    }
+
+    std::vector<Quadric> quadrics(positionCount);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const glm::vec3 &a = positions[positionOf[indices[t * 3]]];
+        const glm::vec3 &b = positions[positionOf[indices[t * 3 + 1]]];
+        const glm::vec3 &c = positions[positionOf[indices[t * 3 + 2]]];
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length <= 0.0f)
+            continue;
+        normal /= length;
+        Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, a));
+        for (int k = 0; k < 3; k++)
+            quadrics[positionOf[indices[t * 3 + k]]].add(plane);
+    }
+
+    std::vector<bool> alive(triangleCount, true);
+    size_t aliveCount = triangleCount;
+    double maxErrorSquared = (double)maxError * maxError;
+
+    struct Collapse {
+        unsigned int from;          // position that disappears
+        unsigned int to;            // position it moves onto
+        unsigned int toVertex;      // vertex that replaces the (single) vertex of from
+        double error;
+    };
+
+    // collapses are applied in passes: every unlocked position proposes its cheapest collapse, then the
+    // cheapest proposals whose neighbourhoods don't overlap are applied
+    for (;;)
+    {
+        if (aliveCount * 3 <= targetIndexCount)
+            break;
+
+        std::vector<unsigned int> adjacencyOffset(positionCount + 1, 0);
+        for (size_t t = 0; t < triangleCount; t++)
+            if (alive[t])
+                for (int k = 0; k < 3; k++)
+                    adjacencyOffset[positionOf[result[t * 3 + k]] + 1]++;
+        for (size_t p = 0; p < positionCount; p++)
+            adjacencyOffset[p + 1] += adjacencyOffset[p];
+        std::vector<unsigned int> adjacency(adjacencyOffset[positionCount]);
+        std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++)
+            if (alive[t])
+                for (int k = 0; k < 3; k++)
+                    adjacency[fill[positionOf[result[t * 3 + k]]]++] = (unsigned int)t;
+
+        std::vector<Collapse> candidates;
+        for (size_t p = 0; p < positionCount; p++)
+        {
+            if (locked[p] || adjacencyOffset[p] == adjacencyOffset[p + 1])
+                continue;
+            Collapse best;
+            best.error = -1.0;
+            for (unsigned int i = adjacencyOffset[p]; i < adjacencyOffset[p + 1]; i++)
+            {
+                unsigned int t = adjacency[i];
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int vertex = result[t * 3 + k];
+                    unsigned int other = positionOf[vertex];
+                    if (other == p)
+                        continue;
+                    Quadric combined = quadrics[p];
+                    combined.add(quadrics[other]);
+                    double error = combined.error(positions[other]);
+                    if (best.error < 0.0 || error < best.error)
+                    {
+                        best.from = (unsigned int)p;
+                        best.to = other;
+                        best.toVertex = vertex;
+                        best.error = error;
+                    }
+                }
+            }
+            if (best.error >= 0.0 && best.error <= maxErrorSquared)
+                candidates.push_back(best);
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+        std::vector<bool> touched(positionCount, false);
+        size_t applied = 0;
+        for (const Collapse &collapse : candidates)
+        {
+            if (aliveCount * 3 <= targetIndexCount)
+                break;
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            // reject collapses that would flip a triangle
+            bool flips = false;
+            for (unsigned int i = adjacencyOffset[collapse.from]; i < adjacencyOffset[collapse.from + 1] && !flips; i++)
+            {
+                unsigned int t = adjacency[i];
+                glm::vec3 before[3], after[3];
+                bool hasTarget = false;
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int p = positionOf[result[t * 3 + k]];
+                    hasTarget = hasTarget || p == collapse.to;
+                    before[k] = positions[p];
+                    after[k] = p == collapse.from ? positions[collapse.to] : positions[p];
+                }
+                if (hasTarget)
+                    continue;
+                glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+                flips = glm::dot(n0, n1) <= 0.0f;
+            }
+            if (flips)
+                continue;
+
+            for (unsigned int i = adjacencyOffset[collapse.from]; i < adjacencyOffset[collapse.from + 1]; i++)
+            {
+                unsigned int t = adjacency[i];
+                bool degenerate = false;
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int &vertex = result[t * 3 + k];
+                    touched[positionOf[vertex]] = true;
+                    if (positionOf[vertex] == collapse.to)
+                        degenerate = true;
+                    if (positionOf[vertex] == collapse.from)
+                        vertex = collapse.toVertex;
+                }
+                if (degenerate && alive[t])
+                {
+                    alive[t] = false;
+                    aliveCount--;
+                }
+            }
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            resultError = std::max(resultError, (float)std::sqrt(collapse.error));
+            applied++;
+        }
+        if (applied == 0)
+            break;
+    }
+
+    std::vector<unsigned int> output;
+    output.reserve(aliveCount * 3);
+    for (size_t t = 0; t < triangleCount; t++)
+        if (alive[t])
+            output.insert(output.end(), result.begin() + t * 3, result.begin() + t * 3 + 3);
+    return output;
+}
+
+// builds up to MAX_MESH_LODS simplified levels of a mesh, each with about half the triangles of the
+// previous one. Stops early once a level can't get meaningfully smaller within the error bound.
+inline std::vector<MeshLod> BuildLodChain(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+{
+    std::vector<MeshLod> lods;
+    AABB box;
+    for (const Vertex &vertex : vertices)
+        box.expand(vertex.Position);
+    if (!box.valid())
+        return lods;
+    float maxError = glm::length(box.max - box.min) * LOD_MAX_RELATIVE_ERROR;
+
+    size_t previousCount = indices.size();
+    for (unsigned int level = 1; level <= MAX_MESH_LODS; level++)
+    {
+        size_t target = (indices.size() >> level) / 3 * 3;
+        if (target < 3)
+            break;
+        MeshLod lod;
+        lod.indices = SimplifyMesh(vertices, indices, target, maxError, lod.error);
+        // not worth a level of its own
+        if (lod.indices.empty() || lod.indices.size() > previousCount * 9 / 10)
+            break;
+        OptimizeVertexCache(lod.indices, vertices.size());
+        previousCount = lod.indices.size();
+        lods.push_back(std::move(lod));
+    }
+    return lods;
+}
+
+#endif
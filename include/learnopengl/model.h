@@ -11,110 +11,381 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_optimizer.h>
+#include <learnopengl/mesh_simplifier.h>
+#include <learnopengl/pack_io_system.h>
+#include <learnopengl/render_queue.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/texture_loader.h>
+#include <learnopengl/texture_registry.h>
 
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// post-processing steps every model is imported with, part of the cooked cache key
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
 
 
 class Model
 {
 public:
     // model data
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// stores all the textures loaded so far, each holds one reference in the TextureRegistry
     vector<Mesh>    meshes;
+    // object space bounds of all meshes
+    AABB bounds;
+    BoundingSphere sphere;
+    // all meshes quantize their positions inside one box, see PositionDecode
+    PositionQuantization quantization;
     string directory;
     bool gammaCorrection;
+    // bake the transforms of static (not animated) nodes into the vertices at import
+    bool preTransformStatic;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, bool preTransform = true) : gammaCorrection(gamma), preTransformStatic(preTransform)
     {
         loadModel(path);
+        updateBounds();
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    Model(Model &&) = default;
+
+    ~Model()
+    {
+        for (const Texture &texture : textures_loaded)
+            TextureRegistry::shared().release(texture.id);
+    }
+
+    // maps the packed vertex positions of every mesh to object space. Has to be applied after the model
+    // matrix (model * PositionDecode()), Submit with a model matrix does that itself.
+    glm::mat4 PositionDecode() const
+    {
+        return quantization.decodeMatrix();
+    }
+
+    // submits the meshes that intersect frustum with model as the model matrix to queue. The whole model
+    // is tested against its bounding sphere first, then every mesh against its box. Every mesh is drawn at
+    // the coarsest level of detail lodSelector allows for its distance, with the variant of shaders that
+    // matches its material, in the pass of its material bucket. With depthShaders, opaque meshes are also
+    // submitted to the depth pre-pass. The mesh's model matrix is model * transform * PositionDecode().
+    void Submit(RenderQueue &queue, ShaderVariants &shaders, ShaderVariants *depthShaders, const glm::mat4 &model,
+                const Frustum &frustum, const LodSelector &lodSelector, CullStats &stats)
     {
+        if (!IsVisible(model, frustum))
+        {
+            stats.culled += meshes.size();
+            return;
+        }
+        glm::mat4 decode = PositionDecode();
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        {
+            Mesh &mesh = meshes[i];
+            glm::mat4 meshModel = mesh.hasTransform ? model * mesh.transform : model;
+            if (meshes.size() > 1 && !frustum.intersects(mesh.bounds.transformed(meshModel)))
+            {
+                stats.culled++;
+                continue;
+            }
+            unsigned int lod = selectMeshLod(mesh, meshModel, lodSelector);
+            glm::vec3 center = glm::vec3(meshModel * glm::vec4(mesh.sphere.center, 1.0f));
+            bool opaque = mesh.Bucket() == MATERIAL_BUCKET_OPAQUE;
+            queue.submit(opaque ? RENDER_PASS_OPAQUE : RENDER_PASS_ALPHA_MASK, shaders.get(mesh.shaderFeatures), mesh, lod,
+                         meshModel * decode, center);
+            if (opaque && depthShaders)
+                queue.submit(RENDER_PASS_DEPTH, depthShaders->get(mesh.shaderFeatures), mesh, lod, meshModel * decode, center);
+            stats.drawn++;
+        }
+    }
+
+    // bounding sphere test of the whole model placed with model
+    bool IsVisible(const glm::mat4 &model, const Frustum &frustum) const
+    {
+        return frustum.intersects(sphere.transformed(model));
+    }
+
+    // level of detail for one instance placed with model: the coarsest level every mesh accepts, so all
+    // meshes of an instance switch together
+    unsigned int SelectLod(const glm::mat4 &model, const LodSelector &lodSelector) const
+    {
+        unsigned int lod = ~0u;
+        for (const Mesh &mesh : meshes)
+            lod = std::min(lod, selectMeshLod(mesh, mesh.hasTransform ? model * mesh.transform : model, lodSelector));
+        return lod == ~0u ? 0 : lod;
+    }
+
+    // triangles of all meshes at full detail
+    unsigned long long TriangleCount() const
+    {
+        unsigned long long triangles = 0;
+        for (const Mesh &mesh : meshes)
+            triangles += mesh.TriangleCount();
+        return triangles;
+    }
+
+    unsigned int LodCount() const
+    {
+        unsigned int count = 1;
+        for (const Mesh &mesh : meshes)
+            count = std::max(count, mesh.LodCount());
+        return count;
+    }
+
+    // submits instances [firstInstance, firstInstance + instanceCount) of the queue's transforms (see
+    // RenderQueue::addTransforms) at level of detail lod to queue, instances are expected to be grouped by
+    // level. Every mesh uses its variant of shaders, opaque meshes are also submitted to the depth pre-pass
+    // with depthShaders.
+    void SubmitInstanced(RenderQueue &queue, ShaderVariants &shaders, ShaderVariants *depthShaders, unsigned int lod,
+                         unsigned int firstInstance, unsigned int instanceCount)
+    {
+        for (Mesh &mesh : meshes)
+        {
+            bool opaque = mesh.Bucket() == MATERIAL_BUCKET_OPAQUE;
+            queue.submitInstanced(opaque ? RENDER_PASS_OPAQUE : RENDER_PASS_ALPHA_MASK, shaders.get(mesh.shaderFeatures), mesh,
+                                  lod, firstInstance, instanceCount);
+            if (opaque && depthShaders)
+                queue.submitInstanced(RENDER_PASS_DEPTH, depthShaders->get(mesh.shaderFeatures), mesh, lod, firstInstance,
+                                      instanceCount);
+        }
     }
 
     void SetShaderTextureNamePrefix(std::string prefix) {
         for (Mesh& mesh: meshes) {
-            mesh.glslIdentifierPrefix = prefix;
+            mesh.SetShaderTextureNamePrefix(prefix);
         }
     }
 private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // decodes material textures on worker threads while the model is being loaded
+    TextureLoader textureLoader;
+    // index into textures_loaded by path relative to the model directory
+    unordered_map<string, size_t> texturesByPath;
+
+    static unsigned int selectMeshLod(const Mesh &mesh, const glm::mat4 &meshModel, const LodSelector &lodSelector)
+    {
+        if (mesh.lods.empty())
+            return 0;
+        glm::vec3 center = glm::vec3(meshModel * glm::vec4(mesh.sphere.center, 1.0f));
+        float scale = MaxScale(meshModel);
+        return mesh.SelectLod(lodSelector.allowedError(center, mesh.sphere.radius * scale, scale));
+    }
+
+    // loads a model from its cooked cache if it is up to date, otherwise imports it with ASSIMP and
+    // refreshes the cache. Meshes are stored in the meshes vector either way.
     void loadModel(string const &path)
     {
-        // read file via ASSIMP
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        uint64_t sourceHash = MeshCache::sourceHash(path);
+        if (loadCooked(path, sourceHash))
+            return;
+
+        // read file via ASSIMP, the model and the files it references come out of the asset pack if it has them
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        if (AssetPack::shared().isOpen())
+            importer.SetIOHandler(new PackIOSystem()); // the importer owns and deletes it
+        const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // process ASSIMP's root node recursively, merging meshes by material
+        processScene(scene);
+        // upload the material textures, they were decoding in the background while meshes were processed
+        finishTextures();
+        classifyAlpha();
+
+        if (!MeshCache::write(path, sourceHash, MODEL_IMPORT_FLAGS, preTransformStatic, meshes))
+            cout << "WARNING::MESH_CACHE:: failed to write cooked file for " << path << endl;
+    }
+
+    // builds the meshes from the cooked file of path, returns false if there is no valid cooked file.
+    // Vertex and index bytes go from the mapping straight into the mesh arena, there is no per-vertex work.
+    bool loadCooked(string const &path, uint64_t sourceHash)
+    {
+        MeshCache cache;
+        if (!cache.open(path, sourceHash, MODEL_IMPORT_FLAGS, preTransformStatic))
+            return false;
+
+        // every mesh was packed with the model's quantization
+        if (!cache.meshes().empty())
+            quantization = cache.meshes()[0].geometry.quantization;
+
+        meshes.reserve(cache.meshes().size());
+        for (const CookedMesh &cooked : cache.meshes())
+        {
+            vector<Texture> textures;
+            for (const CookedTexture &texture : cooked.textures)
+                textures.push_back(loadTexture(texture.path, texture.type));
+            meshes.emplace_back(cooked.geometry, std::move(textures));
+            meshes.back().bounds = cooked.bounds;
+            meshes.back().sphere = cooked.sphere;
+            meshes.back().transform = cooked.transform;
+            meshes.back().hasTransform = cooked.hasTransform;
+            meshes.back().alphaMode = cooked.alphaMode;
+        }
+        finishTextures();
+        classifyAlpha();
+        return true;
+    }
+
+    // geometry of meshes that use one material, merged into a single vertex/index range. Pre-transformed
+    // meshes of the whole model share one batch per material, meshes that keep their node transform one
+    // batch per node and material.
+    struct MaterialBatch {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        vector<Texture> textures;
+        vector<MeshLod> lods;
+        MaterialAlpha alphaMode = MATERIAL_ALPHA_AUTO;
+        glm::mat4 transform = glm::mat4(1.0f);
+        bool hasTransform = false;
+        bool used = false;
+    };
+
+    // batches in the order they were first used, keyed by (node, material), node is nullptr for
+    // pre-transformed geometry
+    struct BatchList {
+        vector<MaterialBatch> batches;
+        map<pair<const aiNode*, unsigned int>, size_t> index;
+
+        MaterialBatch &get(const aiNode *node, unsigned int materialIndex)
+        {
+            auto found = index.find(make_pair(node, materialIndex));
+            if (found != index.end())
+                return batches[found->second];
+            index[make_pair(node, materialIndex)] = batches.size();
+            batches.emplace_back();
+            return batches.back();
+        }
+    };
+
+    // walks the node hierarchy and builds one Mesh per batch: static node transforms are baked into the
+    // vertices so meshes from different nodes can share a vertex/index range and a single draw call,
+    // animated nodes (and every node if preTransformStatic is off) keep their world matrix instead
+    void processScene(const aiScene *scene)
+    {
+        set<string> animatedNodes;
+        for (unsigned int i = 0; i < scene->mNumAnimations; i++)
+        {
+            const aiAnimation *animation = scene->mAnimations[i];
+            for (unsigned int j = 0; j < animation->mNumChannels; j++)
+                animatedNodes.insert(animation->mChannels[j]->mNodeName.C_Str());
+        }
+
+        BatchList batches;
+        processNode(scene->mRootNode, scene, glm::mat4(1.0f), !preTransformStatic, animatedNodes, batches);
+
+        // weld and reorder for the vertex cache, overdraw and vertex fetch. Runs only on import, cooked
+        // models already store the optimized order.
+        for (size_t i = 0; i < batches.batches.size(); i++)
+        {
+            MaterialBatch &batch = batches.batches[i];
+            if (batch.indices.empty())
+                continue;
+            MeshOptimizationReport report = OptimizeMesh(batch.vertices, batch.indices);
+            cout << "MESH_OPTIMIZER:: " << directory << " mesh " << i << ": " << batch.indices.size() / 3 << " triangles, vertices "
+                 << report.verticesBefore << " -> " << report.verticesAfter
+                 << ", ACMR " << report.before.acmr << " -> " << report.after.acmr
+                 << ", ATVR " << report.before.atvr << " -> " << report.after.atvr << endl;
+
+            // simplified levels of detail over the optimized vertices
+            batch.lods = BuildLodChain(batch.vertices, batch.indices);
+            cout << "MESH_SIMPLIFIER:: " << directory << " mesh " << i << ": LOD triangles " << batch.indices.size() / 3;
+            for (const MeshLod &lod : batch.lods)
+                cout << " -> " << lod.indices.size() / 3 << " (error " << lod.error << ")";
+            cout << endl;
+        }
+
+        AABB quantizationBox;
+        for (const MaterialBatch &batch : batches.batches)
+            for (const Vertex &vertex : batch.vertices)
+                quantizationBox.expand(vertex.Position);
+        quantization = PositionQuantization::fromBounds(quantizationBox);
+
+        for (MaterialBatch &batch : batches.batches)
+        {
+            if (batch.indices.empty())
+                continue;
+            meshes.emplace_back(std::move(batch.vertices), std::move(batch.indices), std::move(batch.textures), quantization,
+                                std::move(batch.lods));
+            meshes.back().transform = batch.transform;
+            meshes.back().hasTransform = batch.hasTransform;
+            meshes.back().alphaMode = batch.alphaMode;
+            meshes.back().ComputeBounds();
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // keepTransform is set below animated nodes, their meshes must stay in node space.
+    void processNode(aiNode *node, const aiScene *scene, const glm::mat4 &parentTransform, bool keepTransform,
+                     const set<string> &animatedNodes, BatchList &batches)
     {
+        glm::mat4 transform = parentTransform * toGlm(node->mTransformation);
+        keepTransform = keepTransform || animatedNodes.count(node->mName.C_Str()) > 0;
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            MaterialBatch &batch = batches.get(keepTransform ? node : nullptr, mesh->mMaterialIndex);
+            batch.transform = keepTransform ? transform : glm::mat4(1.0f);
+            batch.hasTransform = keepTransform;
+            processMesh(mesh, scene, keepTransform ? glm::mat4(1.0f) : transform, batch);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, transform, keepTransform, animatedNodes, batches);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // appends mesh, with its vertices transformed by transform, to batch
+    void processMesh(aiMesh *mesh, const aiScene *scene, const glm::mat4 &transform, MaterialBatch &batch)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        vector<Vertex> &vertices = batch.vertices;
+        vector<unsigned int> &indices = batch.indices;
+        unsigned int baseVertex = (unsigned int)vertices.size();
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+        // a mirroring transform flips the winding of every triangle, swap it back
+        bool mirrored = glm::determinant(glm::mat3(transform)) < 0.0f;
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
             Vertex vertex;
+            // attributes a mesh doesn't have are zero, welding compares vertices bitwise
+            vertex.Normal = vertex.Tangent = vertex.Bitangent = glm::vec3(0.0f);
             glm::vec3 vector; // we declare a placeholder vector since assimp_ uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
+            vertex.Position = glm::vec3(transform * glm::vec4(vector, 1.0f));
             // normals
             if (mesh->HasNormals())
             {
                 vector.x = mesh->mNormals[i].x;
                 vector.y = mesh->mNormals[i].y;
                 vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
+                vertex.Normal = safeNormalize(normalMatrix * vector);
             }
             // texture coordinates
             if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
@@ -129,12 +400,12 @@ private:
                 vector.x = mesh->mTangents[i].x;
                 vector.y = mesh->mTangents[i].y;
                 vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
+                vertex.Tangent = safeNormalize(glm::mat3(transform) * vector);
                 // bitangent
                 vector.x = mesh->mBitangents[i].x;
                 vector.y = mesh->mBitangents[i].y;
                 vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
+                vertex.Bitangent = safeNormalize(glm::mat3(transform) * vector);
             }
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
@@ -149,19 +420,28 @@ private:
             aiFace face = mesh->mFaces[i];
             // retrieve all indices of the face and store them in the indices vector
             for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+            {
+                unsigned int k = (mirrored && face.mNumIndices == 3) ? 2 - j : j;
+                indices.push_back(baseVertex + face.mIndices[k]);
+            }
         }
+        // the textures of a material are the same for every mesh using it, look them up once
+        if (batch.used)
+            return;
+        batch.used = true;
+        vector<Texture> &textures = batch.textures;
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+        // glTF states the alpha mode, BLEND isn't sorted here and is alpha-tested like MASK
+        aiString alphaMode;
+        if (material->Get("$mat.gltf.alphaMode", 0, 0, alphaMode) == AI_SUCCESS)
+            batch.alphaMode = std::strcmp(alphaMode.C_Str(), "OPAQUE") == 0 ? MATERIAL_ALPHA_OPAQUE : MATERIAL_ALPHA_MASK;
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
         // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
         // Same applies to other texture as the following list summarizes:
         // diffuse: texture_diffuseN
         // specular: texture_specularN
         // normal: texture_normalN
-        aiColor3D color(0.0f, 0.0f, 0.0f);
-        material->Get(AI_MATKEY_COLOR_AMBIENT, color);
-
 
         // 1. diffuse maps
         vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
@@ -175,11 +455,43 @@ private:
         // 4. height maps
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+    }
 
+    // assimp matrices are row major, glm matrices column major
+    static glm::mat4 toGlm(const aiMatrix4x4 &m)
+    {
+        return glm::mat4(m.a1, m.b1, m.c1, m.d1,
+                         m.a2, m.b2, m.c2, m.d2,
+                         m.a3, m.b3, m.c3, m.d3,
+                         m.a4, m.b4, m.c4, m.d4);
+    }
 
+    // opaque or alpha-masked per mesh, needs the uploaded textures
+    void classifyAlpha()
+    {
+        for (Mesh &mesh : meshes)
+            mesh.ClassifyAlpha();
+    }
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+    static glm::vec3 safeNormalize(const glm::vec3 &v)
+    {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : v;
+    }
+
+    // model bounds enclose the bounds of every mesh, placed with its transform
+    void updateBounds()
+    {
+        bounds = AABB();
+        for (const Mesh &mesh : meshes)
+            bounds.expand(mesh.hasTransform ? mesh.bounds.transformed(mesh.transform) : mesh.bounds);
+        sphere.center = bounds.center();
+        sphere.radius = 0.0f;
+        for (const Mesh &mesh : meshes)
+        {
+            BoundingSphere meshSphere = mesh.hasTransform ? mesh.sphere.transformed(mesh.transform) : mesh.sphere;
+            sphere.radius = std::max(sphere.radius, glm::length(meshSphere.center - sphere.center) + meshSphere.radius);
+        }
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -191,70 +503,47 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
-};
-
-
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
-{
-    string filename = string(path);
-    filename = directory + '/' + filename;
-
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    // uploads the decoded textures through the registry. Textures that turned out to be copies of ones
+    // another model registered are replaced by those, here and in every mesh.
+    void finishTextures()
     {
-//        std::cout << path << '\n';
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+        unordered_map<unsigned int, unsigned int> replaced = TextureRegistry::shared().finish(textureLoader);
+        if (replaced.empty())
+            return;
+        for (Texture &texture : textures_loaded)
+            texture.id = TextureRegistry::replacement(replaced, texture.id);
+        for (Mesh &mesh : meshes)
+            for (Texture &texture : mesh.textures)
+                texture.id = TextureRegistry::replacement(replaced, texture.id);
     }
-    else
+
+    // returns the texture at path (relative to the model directory). Textures are shared with every other
+    // model through the TextureRegistry, this model takes one reference per distinct path.
+    Texture loadTexture(const string &path, const string &typeName)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        // check if texture was loaded before and if so, reuse it: skip loading a new texture
+        auto found = texturesByPath.find(path);
+        if (found != texturesByPath.end())
+            return textures_loaded[found->second]; // a texture with the same filepath has already been loaded. (optimization)
+        // if texture hasn't been loaded by this model, get it from the registry
+        Texture texture;
+        texture.id = TextureRegistry::shared().acquire2D(this->directory + '/' + path, textureLoader);
+        texture.type = typeName;
+        texture.path = path;
+        texturesByPath[path] = textures_loaded.size();
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
     }
+};
 
-    return textureID;
+
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+{
+    return TextureRegistry::shared().load2D(directory + '/' + string(path));
 }
 #endif
@@ -0,0 +1,250 @@
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/render_stats.h>
+#include <learnopengl/shader.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+// queries in flight per object, results are read this many frames late at most, older ones are dropped
+const unsigned int OCCLUSION_QUERY_LATENCY = 3;
+// consecutive occluded results before a visible object is hidden
+const unsigned int OCCLUSION_HIDE_AFTER = 3;
+// proxies are grown by this fraction of their size (plus the near plane distance) so they never lose the
+// depth test against the surfaces of their own object
+const float OCCLUSION_PROXY_MARGIN = 0.02f;
+
+// what to do with an object this frame
+enum OcclusionDecision {
+    OCCLUSION_DRAW,             // visible
+    OCCLUSION_DRAW_CONDITIONAL, // hidden but expensive, drawn under conditional rendering on condition()
+    OCCLUSION_SKIP              // hidden
+};
+
+// Occlusion culling with hardware queries (GL_ANY_SAMPLES_PASSED, core in 3.3). After the frame's passes,
+// the world space bounding box of every object tested this frame is drawn without color and depth writes,
+// inside a query of its own. The results are read in later frames, only once they are available, so the
+// CPU never waits for the GPU.
+//
+// Results go through hysteresis: an object that shows samples is visible at once, a visible object is only
+// hidden after OCCLUSION_HIDE_AFTER occluded results in a row, so objects at the edge of an occluder don't
+// flicker. Hidden objects are still tested every frame. A hidden cheap object isn't drawn at all, a hidden
+// expensive object is drawn with glBeginConditionalRender on its latest query: the GPU, which has that
+// result by then, skips it while it stays occluded and draws it the frame after it shows up, without the
+// readback delay. Objects that weren't tested in the previous frame (outside the frustum) start out visible.
+class OcclusionCuller
+{
+public:
+    OcclusionCuller() = default;
+    OcclusionCuller(const OcclusionCuller &) = delete;
+    OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+
+    ~OcclusionCuller()
+    {
+        for (Object &object : objects)
+            glDeleteQueries(OCCLUSION_QUERY_LATENCY, object.queries);
+        GLState &state = GLState::shared();
+        if (vertexArray != 0)
+        {
+            state.forgetVertexArray(vertexArray);
+            glDeleteVertexArrays(1, &vertexArray);
+        }
+        for (unsigned int buffer : {vertexBuffer, indexBuffer})
+        {
+            if (buffer != 0)
+            {
+                state.forgetBuffer(buffer);
+                glDeleteBuffers(1, &buffer);
+            }
+        }
+    }
+
+    // compiles the proxy program and creates the unit box, its FrameData block is bound to frameDataBinding
+    void init(GLuint frameDataBinding)
+    {
+        proxyProgram.reset(new Shader("resources/shaders/occlusion_proxy.vs", "resources/shaders/depth_only.fs"));
+        proxyProgram->bindUniformBlock("FrameData", frameDataBinding);
+        proxyBoxMin = proxyProgram->uniform<glm::vec3>("boxMin");
+        proxyBoxMax = proxyProgram->uniform<glm::vec3>("boxMax");
+
+        // corners of the unit box, every face as two triangles
+        const float corners[] = {0, 0, 0,  1, 0, 0,  0, 1, 0,  1, 1, 0,  0, 0, 1,  1, 0, 1,  0, 1, 1,  1, 1, 1};
+        const unsigned char indices[] = {0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  0, 1, 4, 1, 5, 4,
+                                         2, 6, 3, 3, 6, 7,  0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5};
+        GLState &state = GLState::shared();
+        glGenVertexArrays(1, &vertexArray);
+        glGenBuffers(1, &vertexBuffer);
+        glGenBuffers(1, &indexBuffer);
+        state.bindVertexArray(vertexArray);
+        state.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        state.bindVertexArray(0);
+    }
+
+    // registers an object, returns its id. Expensive objects are worth a conditional draw of their own.
+    unsigned int add(bool expensive)
+    {
+        Object object;
+        glGenQueries(OCCLUSION_QUERY_LATENCY, object.queries);
+        object.expensive = expensive;
+        objects.push_back(object);
+        return (unsigned int)objects.size() - 1;
+    }
+
+    // starts a frame: collects the results that have arrived, call before the first decide
+    void beginFrame()
+    {
+        frame++;
+        for (Object &object : objects)
+        {
+            if (object.lastTested + 1 < frame)
+            {
+                // not tested last frame, whatever is in flight describes an older view
+                object.visible = true;
+                object.occludedResults = 0;
+                for (unsigned int slot = 0; slot < OCCLUSION_QUERY_LATENCY; slot++)
+                    object.issued[slot] = false;
+                continue;
+            }
+            collect(object);
+        }
+        tests.clear();
+    }
+
+    OcclusionDecision decide(unsigned int id) const
+    {
+        const Object &object = objects[id];
+        if (object.visible)
+            return OCCLUSION_DRAW;
+        return object.expensive ? OCCLUSION_DRAW_CONDITIONAL : OCCLUSION_SKIP;
+    }
+
+    // the query of the object's latest test, for RenderQueue::beginCondition
+    GLuint condition(unsigned int id) const
+    {
+        const Object &object = objects[id];
+        return object.queries[(object.next + OCCLUSION_QUERY_LATENCY - 1) % OCCLUSION_QUERY_LATENCY];
+    }
+
+    // tests the object against this frame's depth at the end of the frame, worldBox is its world space bounds
+    void test(unsigned int id, const AABB &worldBox)
+    {
+        objects[id].lastTested = frame;
+        tests.push_back(std::make_pair(id, worldBox));
+    }
+
+    // draws the proxies of this frame's tests into queries, call after the frame's passes. A camera at
+    // viewPosition inside a proxy would clip its front faces, those objects count as visible.
+    void issue(const glm::vec3 &viewPosition, float nearPlane)
+    {
+        if (tests.empty())
+            return;
+        GLState &state = GLState::shared();
+        proxyProgram->use();
+        state.bindVertexArray(vertexArray);
+        state.colorMask(false);
+        state.depthMask(false);
+        state.depthFunc(GL_LEQUAL);
+        state.setEnabled(GL_CULL_FACE, false);
+        for (const auto &test : tests)
+        {
+            Object &object = objects[test.first];
+            glm::vec3 margin = (test.second.max - test.second.min) * OCCLUSION_PROXY_MARGIN + glm::vec3(nearPlane);
+            AABB proxy;
+            proxy.min = test.second.min - margin;
+            proxy.max = test.second.max + margin;
+            if (proxy.contains(viewPosition))
+            {
+                object.visible = true;
+                object.occludedResults = 0;
+                continue;
+            }
+            unsigned int slot = object.next;
+            object.next = (object.next + 1) % OCCLUSION_QUERY_LATENCY;
+            // a result that hasn't arrived in OCCLUSION_QUERY_LATENCY frames is given up
+            object.issued[slot] = true;
+            object.issuedFrame[slot] = frame;
+            proxyProgram->set(proxyBoxMin, proxy.min);
+            proxyProgram->set(proxyBoxMax, proxy.max);
+            glBeginQuery(GL_ANY_SAMPLES_PASSED, object.queries[slot]);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (void*)0);
+            glEndQuery(GL_ANY_SAMPLES_PASSED);
+            RenderStats::frame().addDraw(12);
+        }
+        state.colorMask(true);
+        state.depthMask(true);
+        state.depthFunc(GL_LESS);
+    }
+
+private:
+    struct Object {
+        GLuint queries[OCCLUSION_QUERY_LATENCY];
+        bool issued[OCCLUSION_QUERY_LATENCY] = {};
+        unsigned long long issuedFrame[OCCLUSION_QUERY_LATENCY] = {};
+        unsigned int next = 0;
+        bool expensive = false;
+        bool visible = true;
+        unsigned int occludedResults = 0;
+        unsigned long long lastTested = 0;
+    };
+
+    std::vector<Object> objects;
+    std::vector<std::pair<unsigned int, AABB>> tests;
+    unsigned long long frame = 0;
+
+    std::unique_ptr<Shader> proxyProgram;
+    UniformHandle<glm::vec3> proxyBoxMin;
+    UniformHandle<glm::vec3> proxyBoxMax;
+    unsigned int vertexArray = 0;
+    unsigned int vertexBuffer = 0;
+    unsigned int indexBuffer = 0;
+
+    // applies the available results of object oldest first, stops at the first one still in flight
+    void collect(Object &object)
+    {
+        for (unsigned int i = 0; i < OCCLUSION_QUERY_LATENCY; i++)
+        {
+            unsigned int slot = oldestIssued(object);
+            if (slot == OCCLUSION_QUERY_LATENCY)
+                return;
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(object.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+            GLuint samplesPassed = GL_FALSE;
+            glGetQueryObjectuiv(object.queries[slot], GL_QUERY_RESULT, &samplesPassed);
+            object.issued[slot] = false;
+            if (samplesPassed)
+            {
+                object.visible = true;
+                object.occludedResults = 0;
+            }
+            else if (++object.occludedResults >= OCCLUSION_HIDE_AFTER)
+                object.visible = false;
+        }
+    }
+
+    // slot of the object's oldest query still waiting to be read, OCCLUSION_QUERY_LATENCY if there is none
+    static unsigned int oldestIssued(const Object &object)
+    {
+        unsigned int oldest = OCCLUSION_QUERY_LATENCY;
+        for (unsigned int slot = 0; slot < OCCLUSION_QUERY_LATENCY; slot++)
+            if (object.issued[slot] && (oldest == OCCLUSION_QUERY_LATENCY || object.issuedFrame[slot] < object.issuedFrame[oldest]))
+                oldest = slot;
+        return oldest;
+    }
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef PACK_IO_SYSTEM_H
+#define PACK_IO_SYSTEM_H
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include <learnopengl/asset_pack.h>
+
+#include <algorithm>
+#include <cstring>
+
+// read-only Assimp stream over a file in the asset pack, reads are copies out of the mapping
+class PackIOStream : public Assimp::IOStream
+{
+public:
+    explicit PackIOStream(const AssetView &asset) : asset(asset), position(0) {}
+
+    size_t Read(void *buffer, size_t size, size_t count) override
+    {
+        if (size == 0)
+            return 0;
+        count = std::min(count, (asset.size - position) / size);
+        std::memcpy(buffer, asset.data + position, size * count);
+        position += size * count;
+        return count;
+    }
+
+    size_t Write(const void *, size_t, size_t) override
+    {
+        return 0;
+    }
+
+    aiReturn Seek(size_t offset, aiOrigin origin) override
+    {
+        // fseek semantics like Assimp's DefaultIOStream, negative offsets arrive wrapped around and wrap back
+        size_t target;
+        if (origin == aiOrigin_SET)
+            target = offset;
+        else if (origin == aiOrigin_CUR)
+            target = position + offset;
+        else
+            target = asset.size + offset;
+        if (target > asset.size)
+            return aiReturn_FAILURE;
+        position = target;
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override { return position; }
+    size_t FileSize() const override { return asset.size; }
+    void Flush() override {}
+
+private:
+    AssetView asset;
+    size_t position;
+};
+
+// Assimp file system that opens files from the shared AssetPack, files the pack doesn't have (and every
+// write) go to the default file system
+class PackIOSystem : public Assimp::IOSystem
+{
+public:
+    bool Exists(const char *file) const override
+    {
+        return AssetPack::shared().contains(file) || fallback.Exists(file);
+    }
+
+    char getOsSeparator() const override
+    {
+        return '/';
+    }
+
+    Assimp::IOStream *Open(const char *file, const char *mode = "rb") override
+    {
+        if (std::strpbrk(mode, "wa+") == nullptr)
+        {
+            AssetView asset = AssetPack::shared().find(file);
+            if (asset.found())
+                return new PackIOStream(asset);
+        }
+        return fallback.Open(file, mode);
+    }
+
+    void Close(Assimp::IOStream *stream) override
+    {
+        // DefaultIOSystem closes its streams by deleting them as well
+        delete stream;
+    }
+
+private:
+    Assimp::DefaultIOSystem fallback;
+};
+
+#endif
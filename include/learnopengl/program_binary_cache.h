@@ -0,0 +1,181 @@
+#ifndef PROGRAM_BINARY_CACHE_H
+#define PROGRAM_BINARY_CACHE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/mapped_file.h>
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// GL 4.1 / ARB_get_program_binary, glad is generated for 3.3 core only
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void (APIENTRYP PFNPROGRAMBINARYCACHEGETPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNPROGRAMBINARYCACHELOADPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNPROGRAMBINARYCACHEPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+// On-disk cache of linked programs (glGetProgramBinary/glProgramBinary). Every program has one file in
+// PROGRAM_BINARY_CACHE_DIR, named after its shader paths. The file stores a key of the shader sources and
+// the driver (vendor, renderer, version), a binary that doesn't match or that the driver rejects is
+// replaced by a normal compile.
+//
+// file layout: magic, version, key, binary format, binary length, binary
+
+const uint32_t PROGRAM_BINARY_MAGIC = 0x42504752; // "RGPB"
+const uint32_t PROGRAM_BINARY_VERSION = 1;
+const char *const PROGRAM_BINARY_CACHE_DIR = "shader_cache";
+
+class ProgramBinaryCache
+{
+public:
+    static ProgramBinaryCache &shared()
+    {
+        static ProgramBinaryCache cache;
+        return cache;
+    }
+
+    // resolves the program binary entry points, call once after gladLoadGLLoader with the same loader.
+    // The cache stays disabled on drivers without GL 4.1 / ARB_get_program_binary or without binary formats.
+    void init(GLADloadproc load, const std::string &directory)
+    {
+        enabled = false;
+        this->directory = directory;
+        if (!hasProgramBinary())
+            return;
+        getProgramBinary = (PFNPROGRAMBINARYCACHEGETPROC)load("glGetProgramBinary");
+        programBinary = (PFNPROGRAMBINARYCACHELOADPROC)load("glProgramBinary");
+        programParameteri = (PFNPROGRAMBINARYCACHEPARAMETERIPROC)load("glProgramParameteri");
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (!getProgramBinary || !programBinary || !programParameteri || formats <= 0)
+            return;
+
+        driverHash = HashBytes(nullptr, 0);
+        const GLenum names[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+        for (GLenum name : names)
+        {
+            const char *value = reinterpret_cast<const char *>(glGetString(name));
+            if (value)
+                driverHash = HashBytes(value, std::strlen(value) + 1, driverHash);
+        }
+        mkdir(directory.c_str(), 0755);
+        enabled = true;
+    }
+
+    bool isEnabled() const { return enabled; }
+
+    // key of a program built from sources on this driver
+    uint64_t key(const std::vector<std::string> &sources) const
+    {
+        uint64_t hash = driverHash;
+        for (const std::string &source : sources)
+            hash = HashBytes(source.c_str(), source.size() + 1, hash);
+        return hash;
+    }
+
+    // loads the cached binary of name into program, returns false if there is none, it is stale or the
+    // driver refuses it. program has to be recreated after a refused binary.
+    bool load(GLuint program, const std::string &name, uint64_t key)
+    {
+        if (!enabled)
+            return false;
+        MappedFile file(pathFor(name));
+        Header header;
+        if (!file.isOpen() || file.size() < sizeof(Header))
+            return false;
+        std::memcpy(&header, file.bytes(), sizeof(Header));
+        if (header.magic != PROGRAM_BINARY_MAGIC || header.version != PROGRAM_BINARY_VERSION || header.key != key ||
+            header.length > file.size() - sizeof(Header))
+            return false;
+        programBinary(program, header.format, file.bytes() + sizeof(Header), (GLsizei)header.length);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+
+    // asks the driver to keep the binary of program retrievable, call before glLinkProgram
+    void prepare(GLuint program)
+    {
+        if (enabled)
+            programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // stores the binary of the linked program under name
+    void store(GLuint program, const std::string &name, uint64_t key)
+    {
+        if (!enabled)
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<unsigned char> binary((size_t)length);
+        Header header;
+        header.magic = PROGRAM_BINARY_MAGIC;
+        header.version = PROGRAM_BINARY_VERSION;
+        header.key = key;
+        GLsizei written = 0;
+        getProgramBinary(program, length, &written, &header.format, binary.data());
+        header.length = (uint32_t)written;
+
+        // written under a temporary name and renamed, a crash never leaves a truncated binary behind
+        std::string path = pathFor(name);
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char *>(binary.data()), written);
+            if (!out)
+            {
+                out.close();
+                std::remove(tmpPath.c_str());
+                std::cout << "WARNING::PROGRAM_BINARY_CACHE:: failed to write " << path << std::endl;
+                return;
+            }
+        }
+        std::rename(tmpPath.c_str(), path.c_str());
+    }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        GLenum format;
+        uint32_t length;
+    };
+
+    bool enabled = false;
+    std::string directory;
+    uint64_t driverHash = 0;
+    PFNPROGRAMBINARYCACHEGETPROC getProgramBinary = nullptr;
+    PFNPROGRAMBINARYCACHELOADPROC programBinary = nullptr;
+    PFNPROGRAMBINARYCACHEPARAMETERIPROC programParameteri = nullptr;
+
+    std::string pathFor(const std::string &name) const
+    {
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)HashBytes(name.data(), name.size()));
+        return directory + "/" + hex + ".glbin";
+    }
+
+    static bool hasProgramBinary()
+    {
+        return GLVersionAtLeast(4, 1) || HasGLExtension("GL_ARB_get_program_binary");
+    }
+};
+
+#endif
@@ -0,0 +1,449 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/mesh_arena.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+typedef void (APIENTRYP PFNRENDERQUEUEMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect,
+                                                                    GLsizei drawcount, GLsizei stride);
+
+// passes of a frame in execution order, the most significant bits of a sort key
+enum RenderPass : unsigned int {
+    RENDER_PASS_DEPTH = 0,      // depth pre-pass of opaque meshes
+    RENDER_PASS_OPAQUE = 1,
+    RENDER_PASS_ALPHA_MASK = 2,
+    RENDER_PASS_COUNT = 3
+};
+
+// sort key layout, most significant first: pass | program | material | mesh | depth. Sorting groups draws
+// by program, then by textures, then by vertex array, and orders each group front to back.
+const unsigned int RENDER_KEY_PASS_BITS = 4;
+const unsigned int RENDER_KEY_PROGRAM_BITS = 10;
+const unsigned int RENDER_KEY_MATERIAL_BITS = 14;
+const unsigned int RENDER_KEY_MESH_BITS = 12;
+const unsigned int RENDER_KEY_DEPTH_BITS = 24;
+
+// commands and model matrices of a mesh that the GPU writes itself (see GpuCuller): commandCount commands
+// from firstCommand in commandBuffer, their baseInstance indexes transformBuffer
+struct IndirectDraw {
+    unsigned int commandBuffer;
+    unsigned int transformBuffer;
+    uint32_t firstCommand;
+    uint32_t commandCount;
+};
+
+// index of an item without an IndirectDraw
+const uint32_t RENDER_QUEUE_NO_INDIRECT = ~0u;
+
+// one draw of a mesh at one level of detail: instances [firstInstance, firstInstance + instanceCount) of
+// the queue's transforms, or the commands of indirectDraws[indirect]
+struct DrawItem {
+    uint64_t key;
+    Mesh *mesh;
+    Shader *shader;
+    uint32_t material;
+    uint32_t lod;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+    uint32_t indirect;
+    GLuint condition;           // occlusion query the draw is conditional on, 0 if none
+};
+
+// layout of a glMultiDrawElementsIndirect command
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// consecutive items that share program, material, vertex array and index type, one multi-draw
+struct DrawBatch {
+    RenderPass pass;
+    Shader *shader;
+    Mesh *mesh;                 // any mesh of the batch, binds the shared material
+    uint32_t material;
+    unsigned int vertexArray;
+    GLenum indexType;
+    uint32_t firstCommand;
+    uint32_t commandCount;
+    unsigned long long triangles;
+    uint32_t indirect;          // RENDER_QUEUE_NO_INDIRECT or the IndirectDraw the batch consists of
+    GLuint condition;
+};
+
+// Draws submitted during a frame, sorted by a 64-bit key and executed one pass at a time. Every draw reads
+// its model matrices as per-instance attributes from the queue's transform buffer, so draws of different
+// meshes only differ in their command. Runs of draws that share program, material and vertex array become
+// one glMultiDrawElementsIndirect on GL 4.3 (or ARB_multi_draw_indirect), on 3.3 they are a loop of
+// instanced base-vertex draws over the same commands. The programs have to read the model matrix from
+// attribute 5, see model_lighting_instanced.vs. Draws submitted with submitIndirect bring commands and
+// transforms written by the GPU and are sorted like the others. Items submitted between beginCondition and
+// endCondition are drawn with conditional rendering and only batched with items of the same query.
+class RenderQueue
+{
+public:
+    // multi-draw indirect is used while this is set and the context supports it
+    bool useMultiDrawIndirect = true;
+
+    RenderQueue() = default;
+    RenderQueue(const RenderQueue &) = delete;
+    RenderQueue &operator=(const RenderQueue &) = delete;
+
+    ~RenderQueue()
+    {
+        for (unsigned int buffer : {transformBuffer, commandBuffer})
+        {
+            if (buffer != 0)
+            {
+                GLState::shared().forgetBuffer(buffer);
+                glDeleteBuffers(1, &buffer);
+            }
+        }
+    }
+
+    // creates the buffers and resolves glMultiDrawElementsIndirect, call once after gladLoadGLLoader with
+    // the same loader
+    void init(GLADloadproc load)
+    {
+        glGenBuffers(1, &transformBuffer);
+        multiDrawElementsIndirect = nullptr;
+        if (GLVersionAtLeast(4, 3) || (HasGLExtension("GL_ARB_multi_draw_indirect") && HasGLExtension("GL_ARB_base_instance")))
+            multiDrawElementsIndirect = (PFNRENDERQUEUEMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+        if (multiDrawElementsIndirect)
+            glGenBuffers(1, &commandBuffer);
+    }
+
+    bool supportsMultiDrawIndirect() const { return multiDrawElementsIndirect != nullptr; }
+
+    // items are ordered front to back by their distance to position, distances beyond farDistance compare equal
+    void setView(const glm::vec3 &position, float farDistance)
+    {
+        viewPosition = position;
+        depthScale = farDistance > 0.0f ? (float)((1u << RENDER_KEY_DEPTH_BITS) - 1) / farDistance : 0.0f;
+    }
+
+    // appends model matrices to the frame's transforms, returns the index of the first one for submitInstanced
+    unsigned int addTransforms(const glm::mat4 *matrices, unsigned int count)
+    {
+        unsigned int first = (unsigned int)transforms.size();
+        transforms.insert(transforms.end(), matrices, matrices + count);
+        return first;
+    }
+
+    // submits a single copy of mesh drawn with model as its model matrix, center is the world space point
+    // its depth is measured at
+    void submit(RenderPass pass, Shader &shader, Mesh &mesh, unsigned int lod, const glm::mat4 &model, const glm::vec3 &center)
+    {
+        items.push_back(makeItem(pass, shader, mesh, lod, depthOf(center), addTransforms(&model, 1), 1));
+    }
+
+    // submits instanceCount instances of mesh, their matrices start at transform firstInstance
+    void submitInstanced(RenderPass pass, Shader &shader, Mesh &mesh, unsigned int lod, unsigned int firstInstance,
+                         unsigned int instanceCount)
+    {
+        items.push_back(makeItem(pass, shader, mesh, lod, 0, firstInstance, instanceCount));
+    }
+
+    // submits draws of mesh whose commands the GPU fills in, they become a batch of their own that is
+    // always a multi-draw, so supportsMultiDrawIndirect() has to be true
+    void submitIndirect(RenderPass pass, Shader &shader, Mesh &mesh, const IndirectDraw &draw)
+    {
+        DrawItem item = makeItem(pass, shader, mesh, 0, 0, 0, 0);
+        item.indirect = (uint32_t)indirectDraws.size();
+        indirectDraws.push_back(draw);
+        items.push_back(item);
+    }
+
+    // items submitted until endCondition are only drawn if query (GL_ANY_SAMPLES_PASSED, issued earlier)
+    // saw samples. The GPU waits for the query, the CPU never does.
+    void beginCondition(GLuint query)
+    {
+        condition = query;
+    }
+
+    void endCondition()
+    {
+        condition = 0;
+    }
+
+    // sorts the items, uploads the transforms and builds the commands of every pass, call once between
+    // the last submit and the first execute
+    void prepare()
+    {
+        std::sort(items.begin(), items.end(), [](const DrawItem &a, const DrawItem &b) { return a.key < b.key; });
+
+        GLState &state = GLState::shared();
+        state.bindBuffer(GL_ARRAY_BUFFER, transformBuffer);
+        // orphaned every frame so the upload doesn't wait for draws of the last frame still reading it
+        glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        if (!transforms.empty())
+            glBufferSubData(GL_ARRAY_BUFFER, 0, transforms.size() * sizeof(glm::mat4), transforms.data());
+
+        buildBatches();
+        if (indirect())
+        {
+            state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+            if (!commands.empty())
+                glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+        }
+    }
+
+    // draws the batches of pass, the queue has to be prepared
+    void execute(RenderPass pass)
+    {
+        GLState &state = GLState::shared();
+        bool multiDraw = indirect();
+        if (multiDraw)
+            state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        Shader *program = nullptr;
+        uint32_t material = ~0u;
+        unsigned int vertexArray = 0;
+        for (const DrawBatch &batch : batches)
+        {
+            if (batch.pass != pass)
+                continue;
+            // samplers belong to the program, a switch binds the material again
+            if (batch.shader != program)
+            {
+                program = batch.shader;
+                program->use();
+                material = ~0u;
+            }
+            // the depth pre-pass program samples no textures
+            if (pass != RENDER_PASS_DEPTH && batch.material != material)
+            {
+                batch.mesh->BindMaterial(*program);
+                material = batch.material;
+            }
+            // batches of a conditional item are skipped by the GPU if its query saw no samples
+            if (batch.condition != 0)
+                glBeginConditionalRender(batch.condition, GL_QUERY_WAIT);
+            drawBatch(batch, multiDraw, vertexArray);
+            if (batch.condition != 0)
+                glEndConditionalRender();
+        }
+    }
+
+    // drops the items of the frame, keeps the ids of programs, materials and meshes
+    void clear()
+    {
+        items.clear();
+        indirectDraws.clear();
+        transforms.clear();
+        commands.clear();
+        batches.clear();
+    }
+
+    size_t size() const { return items.size(); }
+    size_t batchCount() const { return batches.size(); }
+
+private:
+    std::vector<DrawItem> items;
+    std::vector<IndirectDraw> indirectDraws;
+    GLuint condition = 0;
+    std::vector<glm::mat4> transforms;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<DrawBatch> batches;
+    glm::vec3 viewPosition = glm::vec3(0.0f);
+    float depthScale = 0.0f;
+    unsigned int transformBuffer = 0;
+    unsigned int commandBuffer = 0;
+    PFNRENDERQUEUEMULTIDRAWELEMENTSINDIRECTPROC multiDrawElementsIndirect = nullptr;
+
+    // small ids in order of first use, they stay valid for the lifetime of the queue
+    std::unordered_map<const Shader *, uint32_t> programIds;
+    std::unordered_map<const Mesh *, uint32_t> meshIds;
+    std::unordered_map<const Mesh *, uint32_t> meshMaterials;
+    std::vector<std::vector<unsigned int>> materials;
+
+    bool indirect() const
+    {
+        return useMultiDrawIndirect && multiDrawElementsIndirect;
+    }
+
+    static RenderPass passOf(uint64_t key)
+    {
+        return (RenderPass)(key >> (64 - RENDER_KEY_PASS_BITS));
+    }
+
+    // one command per index range of every item, a new batch wherever bound state has to change
+    void buildBatches()
+    {
+        MeshArena &arena = MeshArena::shared();
+        for (const DrawItem &item : items)
+        {
+            Mesh &mesh = *item.mesh;
+            RenderPass pass = passOf(item.key);
+            unsigned int vertexArray = arena.instancedVertexArray(mesh.allocation);
+            if (item.indirect != RENDER_QUEUE_NO_INDIRECT)
+            {
+                // triangle counts are only known to the GPU
+                DrawBatch batch;
+                batch.pass = pass;
+                batch.shader = item.shader;
+                batch.mesh = &mesh;
+                batch.material = item.material;
+                batch.vertexArray = vertexArray;
+                batch.indexType = mesh.indexType;
+                batch.firstCommand = 0;
+                batch.commandCount = 0;
+                batch.triangles = 0;
+                batch.indirect = item.indirect;
+                batch.condition = item.condition;
+                batches.push_back(batch);
+                continue;
+            }
+            if (batches.empty() || batches.back().indirect != RENDER_QUEUE_NO_INDIRECT || batches.back().pass != pass ||
+                batches.back().shader != item.shader || batches.back().material != item.material ||
+                batches.back().vertexArray != vertexArray || batches.back().indexType != mesh.indexType ||
+                batches.back().condition != item.condition)
+            {
+                DrawBatch batch;
+                batch.pass = pass;
+                batch.shader = item.shader;
+                batch.mesh = &mesh;
+                batch.material = item.material;
+                batch.vertexArray = vertexArray;
+                batch.indexType = mesh.indexType;
+                batch.firstCommand = (uint32_t)commands.size();
+                batch.commandCount = 0;
+                batch.triangles = 0;
+                batch.indirect = RENDER_QUEUE_NO_INDIRECT;
+                batch.condition = item.condition;
+                batches.push_back(batch);
+            }
+            DrawBatch &batch = batches.back();
+            size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+            for (const IndexRange &range : mesh.lodRanges[std::min<size_t>(item.lod, mesh.lods.size())])
+            {
+                DrawElementsIndirectCommand command;
+                command.count = (GLuint)range.count;
+                command.instanceCount = item.instanceCount;
+                command.firstIndex = (GLuint)(range.byteOffset / indexSize);
+                command.baseVertex = range.baseVertex;
+                command.baseInstance = item.firstInstance;
+                commands.push_back(command);
+                batch.commandCount++;
+                batch.triangles += (unsigned long long)range.count / 3 * item.instanceCount;
+            }
+        }
+    }
+
+    // the draws of batch, its program and material are bound. vertexArray is the VAO whose instance attributes
+    // point at transform 0 of the queue's transforms, 0 if none does.
+    void drawBatch(const DrawBatch &batch, bool multiDraw, unsigned int &vertexArray)
+    {
+        GLState &state = GLState::shared();
+        state.bindVertexArray(batch.vertexArray);
+        if (batch.indirect != RENDER_QUEUE_NO_INDIRECT)
+        {
+            // the draw's own commands and transforms, the queue's are restored for the next batch
+            const IndirectDraw &draw = indirectDraws[batch.indirect];
+            state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, draw.commandBuffer);
+            batch.mesh->AttachInstances(draw.transformBuffer, 0);
+            multiDrawElementsIndirect(GL_TRIANGLES, batch.indexType,
+                                      (void*)(draw.firstCommand * sizeof(DrawElementsIndirectCommand)),
+                                      (GLsizei)draw.commandCount, 0);
+            RenderStats::frame().addDraw(0);
+            if (multiDraw)
+                state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            vertexArray = 0;
+            return;
+        }
+        size_t indexSize = batch.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        if (multiDraw)
+        {
+            // instance attributes start at transform 0, every command picks its own with baseInstance
+            if (batch.vertexArray != vertexArray)
+                batch.mesh->AttachInstances(transformBuffer, 0);
+            vertexArray = batch.vertexArray;
+            multiDrawElementsIndirect(GL_TRIANGLES, batch.indexType,
+                                      (void*)(batch.firstCommand * sizeof(DrawElementsIndirectCommand)),
+                                      (GLsizei)batch.commandCount, 0);
+            RenderStats::frame().addDraw(batch.triangles);
+            return;
+        }
+        // GL 3.3 has no baseInstance, the instance attributes are pointed at every command's first matrix
+        vertexArray = 0;
+        for (uint32_t i = batch.firstCommand; i < batch.firstCommand + batch.commandCount; i++)
+        {
+            const DrawElementsIndirectCommand &command = commands[i];
+            batch.mesh->AttachInstances(transformBuffer, (size_t)command.baseInstance * sizeof(glm::mat4));
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)command.count, batch.indexType,
+                                              (void*)(command.firstIndex * indexSize), (GLsizei)command.instanceCount,
+                                              command.baseVertex);
+            RenderStats::frame().addDraw((unsigned long long)command.count / 3 * command.instanceCount);
+        }
+    }
+
+    template <typename T>
+    static uint32_t idFor(std::unordered_map<const T *, uint32_t> &ids, const T *object)
+    {
+        auto inserted = ids.insert(std::make_pair(object, (uint32_t)ids.size()));
+        return inserted.first->second;
+    }
+
+    // meshes with the same textures in the same order share a material
+    uint32_t materialOf(const Mesh &mesh)
+    {
+        auto found = meshMaterials.find(&mesh);
+        if (found != meshMaterials.end())
+            return found->second;
+        std::vector<unsigned int> textureIds;
+        for (const Texture &texture : mesh.textures)
+            textureIds.push_back(texture.id);
+        uint32_t material = (uint32_t)(std::find(materials.begin(), materials.end(), textureIds) - materials.begin());
+        if (material == materials.size())
+            materials.push_back(textureIds);
+        meshMaterials[&mesh] = material;
+        return material;
+    }
+
+    uint32_t depthOf(const glm::vec3 &center) const
+    {
+        float depth = glm::length(center - viewPosition) * depthScale;
+        const float maxDepth = (float)((1u << RENDER_KEY_DEPTH_BITS) - 1);
+        return (uint32_t)std::min(std::max(depth, 0.0f), maxDepth);
+    }
+
+    DrawItem makeItem(RenderPass pass, Shader &shader, Mesh &mesh, unsigned int lod, uint32_t depth, unsigned int firstInstance,
+                      unsigned int instanceCount)
+    {
+        DrawItem item;
+        item.mesh = &mesh;
+        item.shader = &shader;
+        // depth pre-pass items share one material, so their batches and sorting ignore textures
+        item.material = pass == RENDER_PASS_DEPTH ? 0 : materialOf(mesh);
+        item.lod = lod;
+        item.firstInstance = firstInstance;
+        item.instanceCount = instanceCount;
+        item.indirect = RENDER_QUEUE_NO_INDIRECT;
+        item.condition = condition;
+        // ids past their field width wrap, which only costs grouping, not correctness
+        uint64_t program = idFor(programIds, (const Shader *)&shader) & ((1u << RENDER_KEY_PROGRAM_BITS) - 1);
+        uint64_t material = item.material & ((1u << RENDER_KEY_MATERIAL_BITS) - 1);
+        uint64_t meshId = idFor(meshIds, (const Mesh *)&mesh) & ((1u << RENDER_KEY_MESH_BITS) - 1);
+        item.key = (uint64_t)pass << (64 - RENDER_KEY_PASS_BITS);
+        item.key |= program << (RENDER_KEY_MATERIAL_BITS + RENDER_KEY_MESH_BITS + RENDER_KEY_DEPTH_BITS);
+        item.key |= material << (RENDER_KEY_MESH_BITS + RENDER_KEY_DEPTH_BITS);
+        item.key |= meshId << RENDER_KEY_DEPTH_BITS;
+        item.key |= depth;
+        return item;
+    }
+};
+
+#endif
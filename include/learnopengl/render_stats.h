@@ -0,0 +1,33 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+// draw call and triangle counters of the current frame, every draw adds to RenderStats::frame()
+struct RenderStats {
+    unsigned int drawCalls = 0;
+    unsigned long long triangles = 0;
+    // state calls that went through GLState, issued to the driver or skipped as redundant
+    unsigned int stateCalls = 0;
+    unsigned int redundantStateCalls = 0;
+
+    void reset()
+    {
+        drawCalls = 0;
+        triangles = 0;
+        stateCalls = 0;
+        redundantStateCalls = 0;
+    }
+
+    void addDraw(unsigned long long triangleCount)
+    {
+        drawCalls++;
+        triangles += triangleCount;
+    }
+
+    static RenderStats &frame()
+    {
+        static RenderStats stats;
+        return stats;
+    }
+};
+
+#endif
@@ -8,14 +8,36 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 #include <common.h>
+
+#include <learnopengl/filesystem.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/program_binary_cache.h>
+
+// GL 4.3, glad is generated for 3.3 core only
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+
+// a uniform location resolved once, ahead of the render loop. The type parameter picks the matching
+// glUniform* call in Shader::set, so setting a handle involves no string and no driver name lookup.
+template<typename T>
+struct UniformHandle
+{
+    GLint location = -1;
+};
+
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly, every entry of defines ("NAME" or "NAME value") is added to
+    // all stages as a #define right after their #version line
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const std::vector<std::string> &defines = std::vector<std::string>())
     {
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
@@ -26,149 +48,278 @@ public:
         std::string vertexCode;
         std::string fragmentCode;
         std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                std::string geometryPathString(geometryPath);
-                geometryPath = geometryPathString.c_str();
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
+        // read through FileSystem so shaders come out of the asset pack when there is one
+        if (!FileSystem::readFileContents(vertexPath, vertexCode) || !FileSystem::readFileContents(fragmentPath, fragmentCode) ||
+            (geometryPath != nullptr && !FileSystem::readFileContents(geometryPath, geometryCode)))
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
+        vertexCode = injectDefines(vertexCode, defines);
+        fragmentCode = injectDefines(fragmentCode, defines);
+        if (geometryPath != nullptr)
+            geometryCode = injectDefines(geometryCode, defines);
+        // 2. reuse the driver's binary from the last run if the sources and the driver are unchanged
+        ProgramBinaryCache &binaryCache = ProgramBinaryCache::shared();
+        std::string cacheName = std::string(vertexPath) + "|" + fragmentPath + "|" + (geometryPath ? geometryPath : "");
+        for (const std::string &define : defines)
+            cacheName += "|" + define;
+        uint64_t cacheKey = binaryCache.key({vertexCode, fragmentCode, geometryCode});
+        ID = glCreateProgram();
+        if (!binaryCache.load(ID, cacheName, cacheKey))
         {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            // stale or refused, a program that failed glProgramBinary is replaced before compiling
+            glDeleteProgram(ID);
+            ID = glCreateProgram();
+            if (compile(vertexCode, fragmentCode, geometryPath != nullptr ? &geometryCode : nullptr))
+                binaryCache.store(ID, cacheName, cacheKey);
         }
-        // shader Program
+
+        reflectUniforms();
+    }
+    // compute program from one source file, needs a GL 4.3 context. defines are injected like above.
+    // ------------------------------------------------------------------------
+    explicit Shader(const char* computePath, const std::vector<std::string> &defines = std::vector<std::string>())
+    {
+        std::string computeCode;
+        if (!FileSystem::readFileContents(computePath, computeCode))
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+        computeCode = injectDefines(computeCode, defines);
+        ProgramBinaryCache &binaryCache = ProgramBinaryCache::shared();
+        std::string cacheName = computePath;
+        for (const std::string &define : defines)
+            cacheName += "|" + define;
+        uint64_t cacheKey = binaryCache.key({computeCode});
         ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
+        if (!binaryCache.load(ID, cacheName, cacheKey))
+        {
+            glDeleteProgram(ID);
+            ID = glCreateProgram();
+            if (compileCompute(computeCode))
+                binaryCache.store(ID, cacheName, cacheKey);
+        }
 
+        reflectUniforms();
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        GLState::shared().useProgram(ID);
+    }
+    // location of an active uniform from the table built at link time, -1 if the program has no such uniform
+    // ------------------------------------------------------------------------
+    GLint getUniformLocation(const std::string &name) const
+    {
+        auto it = uniformLocations.find(name);
+        return it != uniformLocations.end() ? it->second : -1;
+    }
+    // connects the uniform block blockName to a binding point, programs without the block are left alone
+    // ------------------------------------------------------------------------
+    void bindUniformBlock(const std::string &blockName, GLuint binding) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, blockName.c_str());
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
+    // typed handle for the hot path, resolve once and pass it to set()
+    // ------------------------------------------------------------------------
+    template<typename T>
+    UniformHandle<T> uniform(const std::string &name) const
+    {
+        UniformHandle<T> handle;
+        handle.location = getUniformLocation(name);
+        return handle;
     }
-    // utility uniform functions
+    // ------------------------------------------------------------------------
+    void set(UniformHandle<bool> handle, bool value) const { glUniform1i(handle.location, (int)value); }
+    void set(UniformHandle<int> handle, int value) const { glUniform1i(handle.location, value); }
+    void set(UniformHandle<float> handle, float value) const { glUniform1f(handle.location, value); }
+    void set(UniformHandle<glm::vec2> handle, const glm::vec2 &value) const { glUniform2fv(handle.location, 1, &value[0]); }
+    void set(UniformHandle<glm::vec3> handle, const glm::vec3 &value) const { glUniform3fv(handle.location, 1, &value[0]); }
+    void set(UniformHandle<glm::vec4> handle, const glm::vec4 &value) const { glUniform4fv(handle.location, 1, &value[0]); }
+    void set(UniformHandle<glm::mat3> handle, const glm::mat3 &mat) const { glUniformMatrix3fv(handle.location, 1, GL_FALSE, &mat[0][0]); }
+    void set(UniformHandle<glm::mat4> handle, const glm::mat4 &mat) const { glUniformMatrix4fv(handle.location, 1, GL_FALSE, &mat[0][0]); }
+    // utility uniform functions, looked up by name in the uniform table
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(getUniformLocation(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(getUniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(getUniformLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(getUniformLocation(name), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(getUniformLocation(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(getUniformLocation(name), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(getUniformLocation(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(getUniformLocation(name), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(getUniformLocation(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    // name -> location of every active uniform of the program
+    std::unordered_map<std::string, GLint> uniformLocations;
+
+    // inserts the defines after the #version line, which has to stay the first statement of the source
+    // ------------------------------------------------------------------------
+    static std::string injectDefines(const std::string &source, const std::vector<std::string> &defines)
+    {
+        if (defines.empty())
+            return source;
+        std::string block;
+        for (const std::string &define : defines)
+            block += "#define " + define + "\n";
+        // compile errors keep reporting the line numbers of the file
+        block += "#line 2\n";
+        size_t version = source.find("#version");
+        size_t insertAt = version == std::string::npos ? 0 : source.find('\n', version);
+        if (insertAt == std::string::npos)
+            return source + "\n" + block;
+        if (version != std::string::npos)
+            insertAt++;
+        return source.substr(0, insertAt) + block + source.substr(insertAt);
+    }
+
+    // compiles the sources and links them into ID, returns whether linking succeeded
+    // ------------------------------------------------------------------------
+    bool compile(const std::string &vertexCode, const std::string &fragmentCode, const std::string *geometryCode)
+    {
+        const char* vShaderCode = vertexCode.c_str();
+        const char * fShaderCode = fragmentCode.c_str();
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+        // if geometry shader is given, compile geometry shader
+        unsigned int geometry;
+        if(geometryCode != nullptr)
+        {
+            const char * gShaderCode = geometryCode->c_str();
+            geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(geometry, 1, &gShaderCode, NULL);
+            glCompileShader(geometry);
+            checkCompileErrors(geometry, "GEOMETRY");
+        }
+        // shader Program
+        glAttachShader(ID, vertex);
+        glAttachShader(ID, fragment);
+        if(geometryCode != nullptr)
+            glAttachShader(ID, geometry);
+        ProgramBinaryCache::shared().prepare(ID);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessery
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        if(geometryCode != nullptr)
+            glDeleteShader(geometry);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+
+    // compiles a compute shader and links it into ID, returns whether linking succeeded
+    // ------------------------------------------------------------------------
+    bool compileCompute(const std::string &computeCode)
+    {
+        const char *cShaderCode = computeCode.c_str();
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+        checkCompileErrors(compute, "COMPUTE");
+        glAttachShader(ID, compute);
+        ProgramBinaryCache::shared().prepare(ID);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        glDeleteShader(compute);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+
+    // enumerates the active uniforms of the linked program and stores their locations. Arrays are reported
+    // once as "name[0]", so every element is added under its own name as well as the bare array name.
+    // ------------------------------------------------------------------------
+    void reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> nameBuffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+            std::string name(nameBuffer.data(), length);
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            // members of uniform blocks have no location
+            if (location < 0)
+                continue;
+            uniformLocations[name] = location;
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                uniformLocations[base] = location;
+                for (GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+                }
+            }
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
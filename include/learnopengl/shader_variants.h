@@ -0,0 +1,99 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <learnopengl/shader.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// features a program variant is compiled with, each one is a #define in the sources, see SHADER_FEATURE_DEFINES
+enum ShaderFeature : unsigned int {
+    SHADER_BLINN = 1 << 0,          // Blinn-Phong instead of Phong specular
+    SHADER_HAS_SPECULAR = 1 << 1,   // the material has a specular map
+    SHADER_ALPHA_MASK = 1 << 2,     // alpha-tested material, only these variants discard
+};
+
+const char *const SHADER_FEATURE_DEFINES[] = {"BLINN", "HAS_SPECULAR", "ALPHA_MASK"};
+const unsigned int SHADER_FEATURE_COUNT = 3;
+
+// One pair of shader files compiled into a program per combination of ShaderFeature bits. Variants are
+// compiled on first use and kept, so switching a feature switches programs instead of branching per pixel.
+// The variants a scene needs are compiled with precompile before its first frame, so no frame waits on one.
+class ShaderVariants
+{
+public:
+    // features added to every variant that is requested, e.g. SHADER_BLINN while Blinn-Phong is toggled on
+    unsigned int globalFeatures = 0;
+    // features the sources react to, the others are dropped from requests so they don't compile duplicates
+    unsigned int usedFeatures = ~0u;
+
+    // defines are shared by all variants, e.g. "NUM_POINT_LIGHTS 4"
+    ShaderVariants(const std::string &vertexPath, const std::string &fragmentPath,
+                   const std::vector<std::string> &defines = std::vector<std::string>())
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), defines(defines)
+    {
+    }
+
+    ShaderVariants(const ShaderVariants &) = delete;
+    ShaderVariants &operator=(const ShaderVariants &) = delete;
+
+    // runs for every variant right after it's compiled (uniform block bindings, constant uniforms) and for
+    // the variants compiled so far. Leaves the variant's program in use.
+    void onCompile(std::function<void(Shader &)> setup)
+    {
+        this->setup = setup;
+        for (auto &variant : variants)
+            setup(*variant.second);
+    }
+
+    // the program for (features | globalFeatures) & usedFeatures, compiled now if it is the first request
+    Shader &get(unsigned int features)
+    {
+        return variant((features | globalFeatures) & usedFeatures);
+    }
+
+    // compiles the variants of features combined with every subset of toggles, the features that are
+    // switched at runtime (e.g. SHADER_BLINN). globalFeatures is not applied.
+    void precompile(unsigned int features, unsigned int toggles = 0)
+    {
+        features &= usedFeatures;
+        toggles &= usedFeatures;
+        for (unsigned int subset = toggles; ; subset = (subset - 1) & toggles)
+        {
+            variant(features | subset);
+            if (subset == 0)
+                break;
+        }
+    }
+
+    size_t variantCount() const { return variants.size(); }
+
+private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::vector<std::string> defines;
+    std::function<void(Shader &)> setup;
+    std::map<unsigned int, std::unique_ptr<Shader>> variants;
+
+    Shader &variant(unsigned int features)
+    {
+        auto found = variants.find(features);
+        if (found != variants.end())
+            return *found->second;
+        std::vector<std::string> variantDefines = defines;
+        for (unsigned int i = 0; i < SHADER_FEATURE_COUNT; i++)
+            if (features & (1u << i))
+                variantDefines.push_back(SHADER_FEATURE_DEFINES[i]);
+        std::unique_ptr<Shader> shader(new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, variantDefines));
+        if (setup)
+            setup(*shader);
+        Shader &result = *shader;
+        variants[features] = std::move(shader);
+        return result;
+    }
+};
+
+#endif
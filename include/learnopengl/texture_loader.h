@@ -0,0 +1,249 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/asset_pack.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/thread_pool.h>
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+// an image decoded on a worker thread, pixels are owned by stb_image
+struct DecodedImage {
+    unsigned char *data = nullptr;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    // some texel has an alpha below 255
+    bool hasTransparency = false;
+    // HashBytes of the source file, 0 if it couldn't be read
+    uint64_t sourceHash = 0;
+};
+
+// Decodes images on the shared thread pool and uploads them on the GL thread.
+// load2D/loadCubemap reserve the texture name immediately so callers can store it right away, decoding
+// runs in the background and finish() uploads everything that was requested, in request order.
+class TextureLoader
+{
+public:
+    // offered every requested texture by finish() before its upload, with the hashes of its source files
+    // (one per cube map face). Returning another texture name drops this one: it isn't uploaded and its
+    // name is deleted, the caller then uses the returned name instead.
+    typedef std::function<unsigned int(unsigned int textureID, const std::vector<uint64_t> &sourceHashes)> Resolver;
+
+    TextureLoader() = default;
+    TextureLoader(TextureLoader &&) = default;
+    TextureLoader &operator=(TextureLoader &&) = default;
+
+    ~TextureLoader()
+    {
+        finish();
+    }
+
+    // replaces stbi_set_flip_vertically_on_load: stb keeps the flag in a global that workers would race on,
+    // so the loader records it per request and flips rows itself.
+    static void setFlipVertically(bool flip)
+    {
+        flipVertically() = flip;
+    }
+
+    static bool flipsVertically()
+    {
+        return flipVertically();
+    }
+
+    // whether the 2D texture had transparent texels when it was uploaded, used to classify materials as
+    // alpha-masked or opaque
+    static bool hasTransparency(unsigned int textureID)
+    {
+        return transparentTextures().count(textureID) > 0;
+    }
+
+    // mipmapped, repeating 2D texture
+    unsigned int load2D(const std::string &path)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        enqueue(path, textureID, GL_TEXTURE_2D);
+        return textureID;
+    }
+
+    // cube map from faces in +X, -X, +Y, -Y, +Z, -Z order
+    unsigned int loadCubemap(const std::vector<std::string> &faces)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        for (unsigned int i = 0; i < faces.size(); i++)
+            enqueue(faces[i], textureID, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
+        return textureID;
+    }
+
+    // waits for all outstanding decodes and uploads them, must be called on the GL thread. With resolve,
+    // every texture is offered to it first.
+    void finish(const Resolver &resolve = Resolver())
+    {
+        std::set<unsigned int> cubemaps;
+        // the jobs of a texture (the faces of a cube map) are consecutive
+        for (size_t first = 0, end; first < jobs.size(); first = end)
+        {
+            unsigned int textureID = jobs[first].textureID;
+            std::vector<DecodedImage> images;
+            std::vector<uint64_t> sourceHashes;
+            for (end = first; end < jobs.size() && jobs[end].textureID == textureID; end++)
+            {
+                images.push_back(jobs[end].image.get());
+                sourceHashes.push_back(images.back().sourceHash);
+            }
+            bool keep = !resolve || resolve(textureID, sourceHashes) == textureID;
+            for (size_t i = 0; keep && i < images.size(); i++)
+            {
+                const Job &job = jobs[first + i];
+                if (job.target == GL_TEXTURE_2D)
+                {
+                    upload2D(textureID, images[i], job.path);
+                    // texture names are reused after glDeleteTextures, every upload refreshes the flag
+                    if (images[i].hasTransparency)
+                        transparentTextures().insert(textureID);
+                    else
+                        transparentTextures().erase(textureID);
+                }
+                else
+                {
+                    uploadCubemapFace(textureID, job.target, images[i], job.path);
+                    cubemaps.insert(textureID);
+                }
+            }
+            if (!keep)
+                glDeleteTextures(1, &textureID);
+            for (DecodedImage &image : images)
+                stbi_image_free(image.data);
+        }
+        jobs.clear();
+
+        for (unsigned int textureID : cubemaps)
+        {
+            GLState::shared().bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        }
+    }
+
+    // decodes and hashes path (from the asset pack or disk) on the calling thread, flipping it if requested
+    static DecodedImage decode(const std::string &path, bool flip)
+    {
+        DecodedImage image;
+        AssetFile file(path);
+        if (file.isOpen())
+        {
+            image.sourceHash = HashBytes(file.bytes(), file.size());
+            image.data = stbi_load_from_memory(file.bytes(), (int)file.size(), &image.width, &image.height, &image.components, 0);
+        }
+        if (image.data && flip)
+            flipRows(image);
+        if (image.data && image.components == 4)
+        {
+            size_t texels = (size_t)image.width * image.height;
+            for (size_t i = 0; i < texels && !image.hasTransparency; i++)
+                image.hasTransparency = image.data[i * 4 + 3] < 255;
+        }
+        return image;
+    }
+
+private:
+    struct Job {
+        std::string path;
+        unsigned int textureID;
+        GLenum target;
+        std::future<DecodedImage> image;
+    };
+    std::vector<Job> jobs;
+
+    static bool &flipVertically()
+    {
+        static bool flip = false;
+        return flip;
+    }
+
+    static std::set<unsigned int> &transparentTextures()
+    {
+        static std::set<unsigned int> textures;
+        return textures;
+    }
+
+    void enqueue(const std::string &path, unsigned int textureID, GLenum target)
+    {
+        bool flip = flipVertically();
+        Job job;
+        job.path = path;
+        job.textureID = textureID;
+        job.target = target;
+        job.image = ThreadPool::shared().submit([path, flip] { return decode(path, flip); });
+        jobs.push_back(std::move(job));
+    }
+
+    static void flipRows(DecodedImage &image)
+    {
+        size_t rowSize = (size_t)image.width * image.components;
+        std::vector<unsigned char> row(rowSize);
+        for (int y = 0; y < image.height / 2; y++)
+        {
+            unsigned char *top = image.data + (size_t)y * rowSize;
+            unsigned char *bottom = image.data + (size_t)(image.height - 1 - y) * rowSize;
+            std::memcpy(row.data(), top, rowSize);
+            std::memcpy(top, bottom, rowSize);
+            std::memcpy(bottom, row.data(), rowSize);
+        }
+    }
+
+    static GLenum formatFor(int components)
+    {
+        if (components == 1)
+            return GL_RED;
+        if (components == 3)
+            return GL_RGB;
+        return GL_RGBA;
+    }
+
+    static void upload2D(unsigned int textureID, const DecodedImage &image, const std::string &path)
+    {
+        if (!image.data)
+        {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            return;
+        }
+        GLenum format = formatFor(image.components);
+        GLState::shared().bindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    static void uploadCubemapFace(unsigned int textureID, GLenum face, const DecodedImage &image, const std::string &path)
+    {
+        if (!image.data)
+        {
+            std::cout << "Cubemap tex failed to load at this path : " << path << std::endl;
+            return;
+        }
+        GLState::shared().bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        glTexImage2D(face, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.data);
+    }
+};
+
+#endif
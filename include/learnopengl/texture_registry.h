@@ -0,0 +1,232 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/asset_pack.h>
+#include <learnopengl/texture_loader.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Process-wide registry of GL textures keyed by image content and decode options (target, vertical flip),
+// so the same image referenced through different paths or by different models is uploaded once. Textures
+// are reference counted: every acquire must be paired with a release, the texture is deleted with its last
+// reference.
+//
+// Paths seen before are resolved right away. A new path is queued on the loader under a provisional name
+// and hashed on the worker that decodes it, finish() then matches it against the registered contents: a
+// copy of a registered image isn't uploaded and its provisional name is replaced by the registered one.
+class TextureRegistry
+{
+public:
+    static TextureRegistry &shared()
+    {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    TextureRegistry(const TextureRegistry &) = delete;
+    TextureRegistry &operator=(const TextureRegistry &) = delete;
+
+    // mipmapped 2D texture of the image at path, flipped according to TextureLoader::setFlipVertically.
+    // A texture that isn't registered yet is queued on loader, it's ready after finish(loader), which may
+    // replace the returned name.
+    unsigned int acquire2D(const std::string &path, TextureLoader &loader)
+    {
+        return acquire(GL_TEXTURE_2D, std::vector<std::string>(1, path), loader);
+    }
+
+    // cube map of faces in +X, -X, +Y, -Y, +Z, -Z order, keyed by the contents of all six faces
+    unsigned int acquireCubemap(const std::vector<std::string> &faces, TextureLoader &loader)
+    {
+        return acquire(GL_TEXTURE_CUBE_MAP, faces, loader);
+    }
+
+    // uploads what loader decoded. Textures that turn out to be copies of registered ones are dropped, the
+    // result maps their provisional names to the registered names, which now hold their references.
+    std::unordered_map<unsigned int, unsigned int> finish(TextureLoader &loader)
+    {
+        std::unordered_map<unsigned int, unsigned int> replaced;
+        loader.finish([this, &replaced](unsigned int textureID, const std::vector<uint64_t> &sourceHashes) {
+            auto found = pending.find(textureID);
+            if (found == pending.end())
+                return textureID;
+            Key key = found->second.key;
+            for (size_t i = 0; i < sourceHashes.size() && i < found->second.paths.size(); i++)
+                pathHashes[found->second.paths[i]] = sourceHashes[i];
+            key.hash = keyHash(key.target, sourceHashes);
+            pending.erase(found);
+            unsigned int registered;
+            if (acquire(key, registered))
+            {
+                replaced[textureID] = registered;
+                return registered;
+            }
+            add(key, textureID);
+            return textureID;
+        });
+        return replaced;
+    }
+
+    // acquire2D and finish in one, for textures loaded on their own
+    unsigned int load2D(const std::string &path)
+    {
+        TextureLoader loader;
+        unsigned int textureID = acquire2D(path, loader);
+        return replacement(finish(loader), textureID);
+    }
+
+    unsigned int loadCubemap(const std::vector<std::string> &faces)
+    {
+        TextureLoader loader;
+        unsigned int textureID = acquireCubemap(faces, loader);
+        return replacement(finish(loader), textureID);
+    }
+
+    // the name textureID was replaced with by finish, or textureID
+    static unsigned int replacement(const std::unordered_map<unsigned int, unsigned int> &replaced, unsigned int textureID)
+    {
+        auto found = replaced.find(textureID);
+        return found == replaced.end() ? textureID : found->second;
+    }
+
+    // drops one reference to textureID, deletes the texture when it was the last one
+    void release(unsigned int textureID)
+    {
+        auto found = keys.find(textureID);
+        if (found == keys.end())
+        {
+            // unregistered texture (its source couldn't be hashed or it was never finished), it was never shared
+            pending.erase(textureID);
+            GLState::shared().forgetTexture(textureID);
+            glDeleteTextures(1, &textureID);
+            return;
+        }
+        auto entry = entries.find(found->second);
+        if (--entry->second.references > 0)
+            return;
+        GLState::shared().forgetTexture(textureID);
+        glDeleteTextures(1, &textureID);
+        entries.erase(entry);
+        keys.erase(found);
+    }
+
+    // number of distinct textures currently alive
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+private:
+    struct Key {
+        uint64_t hash;
+        GLenum target;
+        bool flip;
+
+        bool operator==(const Key &other) const
+        {
+            return hash == other.hash && target == other.target && flip == other.flip;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const
+        {
+            return (size_t)(key.hash ^ ((uint64_t)key.target << 1) ^ (uint64_t)key.flip);
+        }
+    };
+
+    struct Entry {
+        unsigned int textureID;
+        unsigned int references;
+    };
+
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    std::unordered_map<unsigned int, Key> keys;
+    // content hash of every path decoded so far, a path is read and hashed only once
+    std::unordered_map<std::string, uint64_t> pathHashes;
+
+    // textures queued on a loader whose content isn't known yet, by provisional name
+    struct Pending {
+        Key key;
+        std::vector<std::string> paths;
+    };
+    std::unordered_map<unsigned int, Pending> pending;
+
+    TextureRegistry() = default;
+
+    unsigned int acquire(GLenum target, const std::vector<std::string> &paths, TextureLoader &loader)
+    {
+        Key key;
+        key.target = target;
+        key.flip = TextureLoader::flipsVertically();
+        std::vector<uint64_t> hashes;
+        for (const std::string &path : paths)
+        {
+            auto found = pathHashes.find(path);
+            if (found == pathHashes.end())
+                break;
+            hashes.push_back(found->second);
+        }
+        unsigned int textureID;
+        if (hashes.size() == paths.size())
+        {
+            key.hash = keyHash(target, hashes);
+            if (acquire(key, textureID))
+                return textureID;
+        }
+
+        textureID = target == GL_TEXTURE_2D ? loader.load2D(paths[0]) : loader.loadCubemap(paths);
+        Pending request;
+        request.key = key;
+        request.paths = paths;
+        pending[textureID] = request;
+        return textureID;
+    }
+
+    // the file's hash for a 2D texture, a hash of the faces' hashes for a cube map, 0 if a file can't be read
+    static uint64_t keyHash(GLenum target, const std::vector<uint64_t> &sourceHashes)
+    {
+        if (target == GL_TEXTURE_2D)
+            return sourceHashes.empty() ? 0 : sourceHashes[0];
+        uint64_t hash = HashBytes(nullptr, 0);
+        for (uint64_t faceHash : sourceHashes)
+        {
+            if (faceHash == 0)
+                return 0;
+            hash = HashBytes(&faceHash, sizeof(faceHash), hash);
+        }
+        return hash;
+    }
+
+    bool acquire(const Key &key, unsigned int &textureID)
+    {
+        if (key.hash == 0)
+            return false;
+        auto found = entries.find(key);
+        if (found == entries.end())
+            return false;
+        found->second.references++;
+        textureID = found->second.textureID;
+        return true;
+    }
+
+    unsigned int add(const Key &key, unsigned int textureID)
+    {
+        // sources that can't be read are not shared, loading them reports the error
+        if (key.hash == 0)
+            return textureID;
+        Entry entry;
+        entry.textureID = textureID;
+        entry.references = 1;
+        entries[key] = entry;
+        keys[textureID] = key;
+        return textureID;
+    }
+};
+
+#endif
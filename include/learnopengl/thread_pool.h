@@ -0,0 +1,92 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// fixed-size pool of worker threads for CPU-only jobs (image decoding, mesh processing).
+// Jobs must never touch the GL, the context is only current on the main thread.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount)
+    {
+        if (threadCount == 0)
+            threadCount = 1;
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // process-wide pool with one worker per hardware thread
+    static ThreadPool &shared()
+    {
+        static ThreadPool pool(std::thread::hardware_concurrency());
+        return pool;
+    }
+
+    // queues job and returns a future for its result
+    template<typename F>
+    auto submit(F job) -> std::future<decltype(job())>
+    {
+        typedef decltype(job()) Result;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(job));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push([task] { (*task)(); });
+        }
+        wakeUp.notify_one();
+        return result;
+    }
+
+    unsigned int size() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+
+#include <cstring>
+#include <vector>
+
+// One buffer object holding several std140 uniform blocks. Every block gets its own range, aligned to
+// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, bound to binding point firstBinding + index. Blocks are written into a
+// CPU staging copy with setBlock and reach the GPU with a single buffer write in upload().
+class UniformBuffer
+{
+public:
+    unsigned int ID;
+
+    UniformBuffer(const std::vector<size_t> &blockSizes, GLuint firstBinding)
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        size_t offset = 0;
+        for (size_t size : blockSizes)
+        {
+            offsets.push_back(offset);
+            sizes.push_back(size);
+            offset += (size + alignment - 1) / alignment * alignment;
+        }
+        staging.assign(offset, 0);
+
+        glGenBuffers(1, &ID);
+        GLState::shared().bindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, staging.size(), NULL, GL_DYNAMIC_DRAW);
+        // glBindBufferRange also binds the generic GL_UNIFORM_BUFFER target, which is ID already
+        for (size_t i = 0; i < offsets.size(); i++)
+            glBindBufferRange(GL_UNIFORM_BUFFER, firstBinding + (GLuint)i, ID, offsets[i], sizes[i]);
+    }
+
+    UniformBuffer(const UniformBuffer &) = delete;
+    UniformBuffer &operator=(const UniformBuffer &) = delete;
+
+    ~UniformBuffer()
+    {
+        GLState::shared().forgetBuffer(ID);
+        glDeleteBuffers(1, &ID);
+    }
+
+    // copies the contents of a block into the staging copy, data must match the block's std140 layout
+    template<typename T>
+    void setBlock(unsigned int block, const T &data)
+    {
+        std::memcpy(&staging[offsets[block]], &data, sizes[block] < sizeof(T) ? sizes[block] : sizeof(T));
+    }
+
+    // uploads every block with one write, orphaning the storage the previous frame may still be reading
+    void upload()
+    {
+        GLState::shared().bindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, staging.size(), NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, staging.size(), staging.data());
+    }
+
+private:
+    std::vector<size_t> offsets;
+    std::vector<size_t> sizes;
+    std::vector<unsigned char> staging;
+};
+
+#endif
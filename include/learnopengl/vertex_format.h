@@ -0,0 +1,142 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <learnopengl/bounds.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// vertex as imported and cooked, full precision. Meshes keep it on the CPU and upload a PackedVertex.
+struct Vertex {
+    // position
+    glm::vec3 Position;
+    // normal
+    glm::vec3 Normal;
+    // texCoords
+    glm::vec2 TexCoords;
+    // tangent
+    glm::vec3 Tangent;
+    // bitangent
+    glm::vec3 Bitangent;
+};
+
+// GPU vertex, 16 bytes without and 20 bytes with a tangent frame (instead of 56 bytes of floats):
+//   position : xyz 16-bit unorm inside a PositionQuantization box, w holds the bitangent sign (0 or 1)
+//   normal   : octahedral, 2x 16-bit snorm
+//   texCoords: 2x half float, UVs outside [0, 1] (tiling) stay representable
+//   tangent  : octahedral, 2x 16-bit snorm, only uploaded for meshes with a normal map
+struct PackedVertex {
+    uint16_t position[4];
+    int16_t normal[2];
+    uint16_t texCoords[2];
+    int16_t tangent[2];
+};
+
+const size_t PACKED_VERTEX_SIZE = 16;
+const size_t PACKED_TANGENT_VERTEX_SIZE = 20;
+
+// maps positions inside a box to 16-bit unorm. The decode matrix scales them back, it's folded into the
+// model matrix so the vertex shader never sees quantized coordinates.
+struct PositionQuantization {
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+
+    static PositionQuantization fromBounds(const AABB &box)
+    {
+        PositionQuantization quantization;
+        if (!box.valid())
+            return quantization;
+        quantization.offset = box.min;
+        // flat boxes still get a non-zero scale so decoding stays invertible
+        quantization.scale = glm::max(box.max - box.min, glm::vec3(1e-6f));
+        return quantization;
+    }
+
+    static PositionQuantization fromVertices(const std::vector<Vertex> &vertices)
+    {
+        AABB box;
+        for (const Vertex &vertex : vertices)
+            box.expand(vertex.Position);
+        return fromBounds(box);
+    }
+
+    // unorm position to object space
+    glm::mat4 decodeMatrix() const
+    {
+        return glm::scale(glm::translate(glm::mat4(1.0f), offset), scale);
+    }
+
+    void encode(const glm::vec3 &position, uint16_t out[3]) const
+    {
+        glm::vec3 normalized = glm::clamp((position - offset) / scale, glm::vec3(0.0f), glm::vec3(1.0f));
+        for (int i = 0; i < 3; i++)
+            out[i] = (uint16_t)std::lround(normalized[i] * 65535.0f);
+    }
+};
+
+// octahedral encoding of a unit vector into two snorm16 values
+inline void EncodeOctahedral(const glm::vec3 &v, int16_t out[2])
+{
+    float sum = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+    glm::vec2 p = sum > 0.0f ? glm::vec2(v.x, v.y) / sum : glm::vec2(0.0f);
+    if (v.z < 0.0f)
+    {
+        glm::vec2 folded = glm::vec2(1.0f - std::abs(p.y), 1.0f - std::abs(p.x));
+        p.x = p.x >= 0.0f ? folded.x : -folded.x;
+        p.y = p.y >= 0.0f ? folded.y : -folded.y;
+    }
+    out[0] = (int16_t)std::lround(glm::clamp(p.x, -1.0f, 1.0f) * 32767.0f);
+    out[1] = (int16_t)std::lround(glm::clamp(p.y, -1.0f, 1.0f) * 32767.0f);
+}
+
+// packs vertices into the GPU format, with or without the tangent, stride is the returned size / count
+inline std::vector<unsigned char> PackVertices(const std::vector<Vertex> &vertices, const PositionQuantization &quantization,
+                                               bool withTangents)
+{
+    size_t stride = withTangents ? PACKED_TANGENT_VERTEX_SIZE : PACKED_VERTEX_SIZE;
+    std::vector<unsigned char> packed(vertices.size() * stride);
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const Vertex &vertex = vertices[i];
+        PackedVertex out;
+        quantization.encode(vertex.Position, out.position);
+        // the bitangent is rebuilt as sign * cross(normal, tangent)
+        bool flipped = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f;
+        out.position[3] = flipped ? 0 : 65535;
+        EncodeOctahedral(vertex.Normal, out.normal);
+        out.texCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+        out.texCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+        EncodeOctahedral(vertex.Tangent, out.tangent);
+        std::memcpy(&packed[i * stride], &out, stride);
+    }
+    return packed;
+}
+
+// attribute pointers of the packed format for the bound VAO and GL_ARRAY_BUFFER:
+// 0 position (vec4, w = bitangent sign), 1 octahedral normal (vec2), 2 texCoords (vec2), 3 octahedral tangent (vec2)
+inline void SetupPackedVertexAttributes(bool withTangents)
+{
+    GLsizei stride = (GLsizei)(withTangents ? PACKED_TANGENT_VERTEX_SIZE : PACKED_VERTEX_SIZE);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, texCoords));
+    if (withTangents)
+    {
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, tangent));
+    }
+}
+
+#endif
@@ -7,6 +7,7 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <learnopengl/bounds.h>
 
 enum Direction {
     FORWARD,
@@ -46,6 +47,10 @@ public:
         return glm::lookAt(Position, Position + Front, Up);
     }
 
+    Frustum GetFrustum(const glm::mat4& projection) const {
+        return Frustum::fromMatrix(projection * GetViewMatrix());
+    }
+
     void ProcessKeyboard(Direction direction, float deltaTime) {
         float velocity = MovementSpeed * deltaTime;
        switch (direction) {
@@ -4,9 +4,15 @@ layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
+// per-frame camera data shared by every program, see FrameData in main.cpp
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float padding;
+};
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 void main()
 {
@@ -0,0 +1,26 @@
+#version 430 core
+// copies the instance count of every level of detail into the draw commands of that level, see GpuCuller
+layout (local_size_x = LOCAL_SIZE) in;
+
+// DrawElementsIndirectCommand in render_queue.h
+struct Command {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout (std430, binding = 2) readonly buffer Counters { uint counters[]; };
+layout (std430, binding = 3) buffer Commands { Command commands[]; };
+layout (std430, binding = 4) readonly buffer CommandLods { uint commandLods[]; };
+
+uniform int commandCount;
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= uint(commandCount))
+        return;
+    commands[index].instanceCount = counters[commandLods[index]];
+}
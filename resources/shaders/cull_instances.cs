@@ -0,0 +1,95 @@
+#version 430 core
+// GPU culling of one model's instances, see GpuCuller in gpu_culling.h. One invocation per instance: frustum
+// test, occlusion test against the previous frame's depth pyramid, level of detail, and the model matrix
+// appended to the transforms of its level.
+layout (local_size_x = LOCAL_SIZE) in;
+
+layout (std430, binding = 0) readonly buffer Instances { mat4 instances[]; };
+layout (std430, binding = 1) writeonly buffer Transforms { mat4 transforms[]; };
+layout (std430, binding = 2) buffer Counters { uint counters[]; };
+
+uniform int instanceCount;
+// every instance is drawn with instances[i] * animation * decode
+uniform mat4 animation;
+uniform mat4 decode;
+// object space bounding sphere of the model, xyz center, w radius
+uniform vec4 sphere;
+// world space, normals point inwards, see Frustum in bounds.h
+uniform vec4 frustumPlanes[6];
+
+// levels of detail, lodErrors[l] is the object space error of level l + 1, see LodSelector in lod.h
+uniform int lodCount;
+uniform float lodErrors[MAX_LODS];
+uniform vec3 viewPosition;
+uniform float pixelsPerUnit;
+uniform float maxPixelError;
+
+// farthest depth per texel of the last frame, level 0 is pyramidSize texels
+uniform bool occlusion;
+uniform mat4 previousViewProjection;
+uniform sampler2D depthPyramid;
+uniform vec2 pyramidSize;
+uniform int pyramidLevels;
+
+bool insideFrustum(vec3 center, float radius)
+{
+    for (int i = 0; i < 6; i++)
+        if (dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w < -radius)
+            return false;
+    return true;
+}
+
+// the sphere's bounding box is behind the last frame's depths everywhere on its screen rectangle
+bool occluded(vec3 center, float radius)
+{
+    vec2 uvMin = vec2(1.0);
+    vec2 uvMax = vec2(0.0);
+    float nearestDepth = 1.0;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        vec3 offset = vec3((corner & 1) != 0 ? radius : -radius, (corner & 2) != 0 ? radius : -radius,
+                           (corner & 4) != 0 ? radius : -radius);
+        vec4 clip = previousViewProjection * vec4(center + offset, 1.0);
+        // crosses the near plane, the projection isn't bounded
+        if (clip.w <= 0.0)
+            return false;
+        vec3 ndc = clip.xyz / clip.w;
+        uvMin = min(uvMin, ndc.xy * 0.5 + 0.5);
+        uvMax = max(uvMax, ndc.xy * 0.5 + 0.5);
+        nearestDepth = min(nearestDepth, ndc.z * 0.5 + 0.5);
+    }
+    // parts outside the last frame's view have no depths to test against
+    if (any(lessThan(uvMin, vec2(0.0))) || any(greaterThan(uvMax, vec2(1.0))))
+        return false;
+    // the level at which the rectangle spans at most two texels per axis
+    vec2 extent = (uvMax - uvMin) * pyramidSize;
+    float level = clamp(ceil(log2(max(max(extent.x, extent.y), 1.0))), 0.0, float(pyramidLevels - 1));
+    float farthest = max(max(textureLod(depthPyramid, uvMin, level).r, textureLod(depthPyramid, vec2(uvMax.x, uvMin.y), level).r),
+                         max(textureLod(depthPyramid, vec2(uvMin.x, uvMax.y), level).r, textureLod(depthPyramid, uvMax, level).r));
+    return nearestDepth > farthest;
+}
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= uint(instanceCount))
+        return;
+    mat4 model = instances[index] * animation;
+    vec3 center = vec3(model * vec4(sphere.xyz, 1.0));
+    float scale = max(length(model[0].xyz), max(length(model[1].xyz), length(model[2].xyz)));
+    float radius = sphere.w * scale;
+    if (!insideFrustum(center, radius))
+        return;
+    if (occlusion && occluded(center, radius))
+        return;
+
+    // coarsest level whose error stays below maxPixelError pixels
+    float distance = max(length(center - viewPosition) - radius, 1e-3);
+    float allowedError = maxPixelError * distance / (pixelsPerUnit * max(scale, 1e-6));
+    int lod = 0;
+    while (lod + 1 < lodCount && lodErrors[lod] <= allowedError)
+        lod++;
+
+    uint slot = atomicAdd(counters[lod], 1u);
+    transforms[uint(lod) * uint(instanceCount) + slot] = model * decode;
+}
@@ -0,0 +1,6 @@
+#version 330 core
+// depth pre-pass: the vertex shader is the one of the lit pass (with invariant gl_Position) so depths match
+// exactly under GL_EQUAL, there is nothing to shade
+void main()
+{
+}
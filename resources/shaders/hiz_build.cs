@@ -0,0 +1,35 @@
+#version 430 core
+// one level of the depth pyramid, see GpuCuller. With COPY_DEPTH level 0 is filled from the depth texture,
+// whose size isn't a power of two, otherwise a level is the 2x2 maximum of the level above.
+layout (local_size_x = LOCAL_SIZE, local_size_y = LOCAL_SIZE) in;
+
+layout (r32f, binding = 1) writeonly uniform image2D destination;
+#ifdef COPY_DEPTH
+uniform sampler2D depthTexture;
+#else
+layout (r32f, binding = 0) readonly uniform image2D source;
+#endif
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(destination);
+    if (texel.x >= size.x || texel.y >= size.y)
+        return;
+    float farthest = 0.0;
+#ifdef COPY_DEPTH
+    // every depth pixel the texel overlaps
+    ivec2 depthSize = textureSize(depthTexture, 0);
+    ivec2 first = texel * depthSize / size;
+    ivec2 last = min(((texel + 1) * depthSize + size - 1) / size, depthSize);
+    for (int y = first.y; y < last.y; y++)
+        for (int x = first.x; x < last.x; x++)
+            farthest = max(farthest, texelFetch(depthTexture, ivec2(x, y), 0).r);
+#else
+    ivec2 sourceSize = imageSize(source);
+    for (int y = 0; y < 2; y++)
+        for (int x = 0; x < 2; x++)
+            farthest = max(farthest, imageLoad(source, min(texel * 2 + ivec2(x, y), sourceSize - 1)).r);
+#endif
+    imageStore(destination, texel, vec4(farthest));
+}
@@ -1,75 +1,101 @@
 #version 330 core
+// variants, defined by ShaderVariants after the #version line:
+//   BLINN            Blinn-Phong instead of Phong specular
+//   HAS_SPECULAR     the material has a specular map, without one the diffuse texture is the specular color
+//   ALPHA_MASK       alpha-tested material, opaque variants never discard and keep early depth testing
+//   NUM_POINT_LIGHTS size of the point light array in LightData
+#ifndef NUM_POINT_LIGHTS
+#define NUM_POINT_LIGHTS 1
+#endif
+
 out vec4 FragColor;
 
+// light structs are laid out as vec3 + float pairs so that their std140 layout matches the C++
+// PointLight/SpotLight structs in main.cpp byte for byte
 struct PointLight {
     vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
     float constant;
+    vec3 ambient;
     float linear;
+    vec3 diffuse;
     float quadratic;
+    vec3 specular;
 };
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-
-    float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float constant;
     vec3 diffuse;
+    float linear;
     vec3 specular;
+    float quadratic;
 };
 
 struct Material {
     sampler2D texture_diffuse1;
+#ifdef HAS_SPECULAR
     sampler2D texture_specular1;
+#endif
 
     float shininess;
 };
+
+// material inputs of a fragment, sampled once and shared by every light
+struct Surface {
+    vec3 normal;
+    vec4 albedo;
+    vec3 specular;
+};
+
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
 
-uniform PointLight pointLight;
-uniform SpotLight spotLight;
+// per-frame camera data shared by every program, see FrameData in main.cpp
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float padding;
+};
+
+layout (std140) uniform LightData {
+    PointLight pointLights[NUM_POINT_LIGHTS];
+    SpotLight spotLight;
+};
+
 uniform Material material;
 
-uniform bool blinn;
+float SpecularFactor(vec3 lightDir, vec3 normal, vec3 viewDir)
+{
+#ifdef BLINN
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    return pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+#else
+    vec3 reflectDir = reflect(-lightDir, normal);
+    return pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+#endif
+}
 
-uniform vec3 viewPosition;
 // calculates the color when using a point light.
-vec4 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec4 CalcPointLight(PointLight light, Surface surface, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
+    float diff = max(dot(surface.normal, lightDir), 0.0);
     // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = 0.0;
-    if(blinn)
-    {
-        vec3 halfwayDir = normalize(lightDir + viewDir);
-        spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-    }
-    else
-    {
-        spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    }
+    float spec = SpecularFactor(lightDir, surface.normal, viewDir);
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
     // combine results
-    vec4 ambient = vec4(light.ambient, 1.0) * texture(material.texture_diffuse1, TexCoords);
-    vec4 diffuse = vec4(light.diffuse, 1.0) * diff * texture(material.texture_diffuse1, TexCoords);
-    vec4 specular = vec4(light.specular, 1.0) * spec * vec4(texture(material.texture_specular1, TexCoords).xxx, 1.0);
+    vec4 ambient = vec4(light.ambient, 1.0) * surface.albedo;
+    vec4 diffuse = vec4(light.diffuse, 1.0) * diff * surface.albedo;
+    vec4 specular = vec4(light.specular, 1.0) * spec * vec4(surface.specular.xxx, 1.0);
 
     ambient *= attenuation;
     diffuse *= attenuation;
@@ -77,30 +103,19 @@ vec4 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     return (ambient + diffuse + specular);
 }
 
-vec3 CalculateSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalculateSpotLight(SpotLight light, Surface surface, vec3 fragPos, vec3 viewDir)
 {
     vec3 lightDir = normalize(light.position - fragPos);
-    float diff = max(dot(normal, lightDir), 0.0);
-    vec3 normalNew = normalize(Normal);
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = 0.0;
-    if(blinn)
-    {
-        vec3 halfwayDir = normalize(lightDir + viewDir);
-        spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-    }
-    else
-    {
-        spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    }
+    float diff = max(dot(surface.normal, lightDir), 0.0);
+    float spec = SpecularFactor(lightDir, surface.normal, viewDir);
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
     float theta = dot(lightDir, normalize(-light.direction));
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+    vec3 ambient = light.ambient * surface.albedo.rgb;
+    vec3 diffuse = light.diffuse * diff * surface.albedo.rgb;
+    vec3 specular = light.specular * spec * surface.specular;
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
@@ -110,11 +125,25 @@ vec3 CalculateSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir
 
 void main()
 {
-    vec3 normal = normalize(Normal);
-    vec3 viewDir = normalize(viewPosition - FragPos);
-    vec4 result = CalcPointLight(pointLight, normal, FragPos, viewDir);
-    result += vec4(CalculateSpotLight(spotLight, normal, FragPos, viewDir), 1.0);
-    if(result.a < 0.7)
+    Surface surface;
+    surface.albedo = texture(material.texture_diffuse1, TexCoords);
+#ifdef ALPHA_MASK
+    // the mask is the texture's alpha, lighting doesn't keep it
+    if (surface.albedo.a < 0.7)
         discard;
+#endif
+#ifdef HAS_SPECULAR
+    surface.specular = texture(material.texture_specular1, TexCoords).rgb;
+#else
+    // an unbound specular sampler reads unit 0, the diffuse texture
+    surface.specular = surface.albedo.rgb;
+#endif
+    surface.normal = normalize(Normal);
+
+    vec3 viewDir = normalize(viewPosition - FragPos);
+    vec4 result = vec4(0.0);
+    for (int i = 0; i < NUM_POINT_LIGHTS; i++)
+        result += CalcPointLight(pointLights[i], surface, FragPos, viewDir);
+    result += vec4(CalculateSpotLight(spotLight, surface, FragPos, viewDir), 1.0);
     FragColor = result;
-}
\ No newline at end of file
+}
@@ -0,0 +1,38 @@
+#version 330 core
+// packed vertex format, see PackedVertex in vertex_format.h
+layout (location = 0) in vec4 aPos;       // xyz unorm inside the model's quantization box, the model matrix decodes it,
+                                          // w bitangent sign (0 = -1, 1 = +1)
+layout (location = 1) in vec2 aNormal;    // octahedral
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in mat4 aInstanceModel;
+
+// the depth pre-pass draws with this shader too, the lit pass tests its depths with GL_EQUAL
+invariant gl_Position;
+
+out vec2 TexCoords;
+out vec3 Normal;
+out vec3 FragPos;
+
+// per-frame camera data shared by every program, see FrameData in main.cpp
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float padding;
+};
+
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0)
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(v);
+}
+
+void main()
+{
+    FragPos = vec3(aInstanceModel * vec4(aPos.xyz, 1.0));
+    Normal = octahedralDecode(aNormal);
+    TexCoords = aTexCoords;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#version 330 core
+// bounding box proxy of an occlusion query, see OcclusionCuller. The unit box is stretched over the world
+// space box, depth_only.fs is the fragment shader.
+layout (location = 0) in vec3 aPos;
+
+// per-frame camera data shared by every program, see FrameData in main.cpp
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+    float padding;
+};
+
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+void main()
+{
+    gl_Position = projection * view * vec4(mix(boxMin, boxMax, aPos), 1.0);
+}
@@ -9,12 +9,28 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <learnopengl/asset_pack.h>
+#include <learnopengl/bench.h>
 #include <learnopengl/filesystem.h>
+#include <learnopengl/framebuffer.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/gpu_culling.h>
+#include <learnopengl/gpu_timer.h>
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
+#include <learnopengl/occlusion_culling.h>
+#include <learnopengl/program_binary_cache.h>
+#include <learnopengl/texture_loader.h>
+#include <learnopengl/texture_registry.h>
+#include <learnopengl/uniform_buffer.h>
+#ifdef PROJECT_BASE_HAVE_EGL
+#include <learnopengl/headless_context.h>
+#endif
 
+#include <cstdio>
 #include <iostream>
+#include <memory>
 
 #include <vector>
 
@@ -32,11 +48,32 @@ unsigned int loadCubemap(vector<std::string> faces);
 
 unsigned int loadTexture(char const * path);
 
+int runScene(GLFWwindow *window, const BenchOptions &bench, GLADloadproc glLoader);
+
+
 // settings
 const unsigned int SCR_WIDTH = 1600;
 const unsigned int SCR_HEIGHT = 900;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 300.0f;
+// models with more triangles are drawn under conditional rendering while occlusion queries find them hidden
+const unsigned long long OCCLUSION_EXPENSIVE_TRIANGLES = 20000;
+// meteors are drawn instanced, raising this costs no extra draw calls
+const unsigned int METEOR_COUNT = 200;
 bool blinn = false;
 bool blinnKeyPressed = false;
+// P toggles a depth-only pass before the lit pass, the lit pass then shades every pixel once
+bool depthPrepass = false;
+bool depthPrepassKeyPressed = false;
+// M switches the render queue between glMultiDrawElementsIndirect (GL 4.3) and a loop of draws
+bool multiDrawIndirect = true;
+bool multiDrawIndirectKeyPressed = false;
+// G culls and picks levels of detail of the meteors with compute shaders (GL 4.3) instead of on the CPU
+bool gpuCulling = false;
+bool gpuCullingKeyPressed = false;
+// O skips models and meteors hidden behind others, found with occlusion queries on their bounding boxes
+bool occlusionCulling = false;
+bool occlusionCullingKeyPressed = false;
 
 // camera
 float lastX = SCR_WIDTH / 2.0f;
@@ -47,32 +84,53 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// PointLight and SpotLight are laid out like their std140 counterparts in model_lighting.fs (vec3 + float
+// pairs) so LightData can be copied into the uniform buffer as is
 struct PointLight {
     glm::vec3 position;
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-
     float constant;
+    glm::vec3 ambient;
     float linear;
+    glm::vec3 diffuse;
     float quadratic;
+    glm::vec3 specular;
+    float padding;
 };
 
 struct SpotLight {
     glm::vec3 position;
-    glm::vec3 direction;
     float cutOff;
+    glm::vec3 direction;
     float outerCutOff;
-
+    glm::vec3 ambient;
     float constant;
+    glm::vec3 diffuse;
     float linear;
+    glm::vec3 specular;
     float quadratic;
+};
 
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
+// std140 uniform blocks shared by all programs in resources/shaders, written once per frame
+const GLuint FRAME_DATA_BINDING = 0;
+const GLuint LIGHT_DATA_BINDING = 1;
+// size of the point light array in LightData, compiled into the lighting shaders as NUM_POINT_LIGHTS
+const unsigned int NUM_POINT_LIGHTS = 1;
+
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPosition;
+    float padding;
 };
 
+struct LightData {
+    PointLight pointLights[NUM_POINT_LIGHTS];
+    SpotLight spotLight;
+};
+
+static_assert(sizeof(FrameData) == 144, "FrameData must match the std140 layout of the FrameData block");
+static_assert(sizeof(LightData) == 64 * NUM_POINT_LIGHTS + 80, "LightData must match the std140 layout of the LightData block");
+
 struct ProgramState {
     glm::vec3 clearColor = glm::vec3(0);
     bool ImGuiEnabled = false;
@@ -89,9 +147,10 @@ struct ProgramState {
     float treeScale = 0.7f;
     float meteorScale = 0.4f;
     float platformScale = 0.2f;
-    float ufoScale = 0.135f;
+    // ufo and alien scales compensate the scaling of their glTF node hierarchies
+    float ufoScale = 13.5f;
     float plantScale = 0.5f;
-    float alienScale = 3.0f;
+    float alienScale = 0.748f;
     float spaceshipScale = 0.7f;
 
     PointLight pointLight;
@@ -139,47 +198,116 @@ ProgramState *programState;
 
 //void DrawImGui(ProgramState *programState);
 
-int main() {
-    // glfw: initialize and configure
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+int main(int argc, char **argv) {
+    // --pack writes resources/ into one archive and exits, later runs read every asset from it
+    if (argc > 1 && std::string(argv[1]) == "--pack")
+        return AssetPack::write(FileSystem::getPath(ASSET_PACK_FILE), {"resources"}) ? 0 : -1;
+
+    // --bench renders a scripted camera flight offscreen, without a window, and prints frame statistics
+    BenchOptions bench = BenchOptions::parse(argc, argv);
+    // statistics printed to stdout stay parseable, every other message goes to stderr
+    if (bench.enabled && bench.outputPath.empty())
+        RedirectBenchDiagnostics();
+    AssetPack::shared().open(FileSystem::getPath(ASSET_PACK_FILE));
+    GLFWwindow *window = NULL;
+    // glLoader resolves the GL entry points beyond glad's 3.3 core: eglGetProcAddress (through
+    // HeadlessContext::getProcAddress) for --bench, glfwGetProcAddress for the window
+    GLADloadproc glLoader = NULL;
+#ifdef PROJECT_BASE_HAVE_EGL
+    HeadlessContext headlessContext;
+#endif
+
+    if (bench.enabled) {
+#ifdef PROJECT_BASE_HAVE_EGL
+        if (!headlessContext.create(3, 3)) {
+            std::cout << "Failed to create headless context" << std::endl;
+            return -1;
+        }
+        if (!gladLoadGLLoader((GLADloadproc) HeadlessContext::getProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+        glLoader = (GLADloadproc) HeadlessContext::getProcAddress;
+#else
+        std::cout << "--bench is not available, project_base was built without EGL" << std::endl;
+        return -1;
+#endif
+    } else {
+        // glfw: initialize and configure
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    // glfw window creation
-    GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == NULL) {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetKeyCallback(window, key_callback);
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-    // glad: load all OpenGL function pointers
-    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        // glfw window creation
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+        if (window == NULL) {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetKeyCallback(window, key_callback);
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // glad: load all OpenGL function pointers
+        if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+        glLoader = (GLADloadproc) glfwGetProcAddress;
     }
+    // linked programs are cached on disk, the next start skips compiling unchanged shaders
+    ProgramBinaryCache::shared().init(glLoader, FileSystem::getPath(PROGRAM_BINARY_CACHE_DIR));
 
-    // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
-    stbi_set_flip_vertically_on_load(true);
+    // tell the texture loader to flip loaded texture's on the y-axis (before loading model).
+    TextureLoader::setFlipVertically(true);
 
     programState = new ProgramState;
-    programState->LoadFromFile("resources/program_state.txt");
-    if (programState->ImGuiEnabled) {
+    // benchmark runs always start from the defaults so they're comparable
+    if (!bench.enabled)
+        programState->LoadFromFile("resources/program_state.txt");
+    if (window && programState->ImGuiEnabled) {
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
     }
 
+    // every GL object is created and destroyed inside runScene, before the context goes away below
+    int result = runScene(window, bench, glLoader);
+    if (bench.enabled) {
+        delete programState;
+        return result;
+    }
+
+    programState->SaveToFile("resources/program_state.txt");
+    delete programState;
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplGlfw_Shutdown();
+    ImGui::DestroyContext();
+
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    glfwTerminate();
+    return 0;
+}
+
+
+// loads the scene and runs the render loop. The GL objects it owns are destroyed when it returns, while the
+// context is still current. Returns the exit code of a benchmark run, 0 after the window was closed.
+int runScene(GLFWwindow *window, const BenchOptions &bench, GLADloadproc glLoader) {
+    // without a window everything is rendered into an offscreen framebuffer of the window's size
+    std::unique_ptr<Framebuffer> offscreen;
+    if (bench.enabled) {
+        offscreen.reset(new Framebuffer(SCR_WIDTH, SCR_HEIGHT));
+        offscreen->bind();
+    }
+
     /*
     // Init Imgui
     IMGUI_CHECKVERSION();
@@ -192,14 +320,41 @@ int main() {
 
     programState->camera.MovementSpeed = 7.0f;
 
-    // configure global opengl state
-    glEnable(GL_DEPTH_TEST);
+    // configure global opengl state, state changes go through GLState so redundant ones are skipped
+    GLState &glState = GLState::shared();
+    glState.setEnabled(GL_DEPTH_TEST, true);
 
     // build and compile shaders
-    Shader ourShader("resources/shaders/model_lighting.vs", "resources/shaders/model_lighting.fs");
+    // lighting programs are compiled per material and lighting feature, see ShaderVariants
+    vector<string> lightingDefines = {"NUM_POINT_LIGHTS " + std::to_string(NUM_POINT_LIGHTS)};
+    // the render queue feeds every model matrix as an instance attribute, single models are one instance
+    ShaderVariants modelShaders("resources/shaders/model_lighting_instanced.vs", "resources/shaders/model_lighting.fs", lightingDefines);
+    // depth pre-pass program, the lit vertex shader (gl_Position is invariant so GL_EQUAL matches) with an
+    // empty fragment shader. No feature changes its output, so every material shares one variant.
+    ShaderVariants depthShaders("resources/shaders/model_lighting_instanced.vs", "resources/shaders/depth_only.fs", lightingDefines);
+    depthShaders.usedFeatures = 0;
     Shader skyShader("resources/shaders/sky_shader.vs", "resources/shaders/sky_shader.fs");
     Shader boxShader("resources/shaders/box_shader.vs", "resources/shaders/box_shader.fs");
 
+    // camera and light data reach every program through one uniform buffer
+    UniformBuffer frameUniforms({sizeof(FrameData), sizeof(LightData)}, FRAME_DATA_BINDING);
+    for (Shader *shader : {&skyShader, &boxShader}) {
+        shader->bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+        shader->bindUniformBlock("LightData", LIGHT_DATA_BINDING);
+    }
+    modelShaders.onCompile([](Shader &shader) {
+        shader.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+        shader.bindUniformBlock("LightData", LIGHT_DATA_BINDING);
+        shader.use();
+        shader.setFloat("material.shininess", 32.0f);
+    });
+    depthShaders.onCompile([](Shader &shader) {
+        shader.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+    });
+
+    // uniform handles used every frame
+    UniformHandle<glm::mat4> boxModel = boxShader.uniform<glm::mat4>("model");
+
     // cube vertices
     float vertices[] = {
             // Back face
@@ -297,9 +452,9 @@ int main() {
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
 
-    glBindVertexArray(VAO);
+    glState.bindVertexArray(VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
     // position attribute
@@ -317,8 +472,8 @@ int main() {
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
+    glState.bindVertexArray(skyboxVAO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
@@ -351,33 +506,43 @@ int main() {
     Model tree("resources/objects/alien_tree/untitled.obj");
     tree.SetShaderTextureNamePrefix("material.");
 
-    stbi_set_flip_vertically_on_load(false);
+    TextureLoader::setFlipVertically(false);
     Model meteor("resources/objects/meteor/untitled.obj");
     meteor.SetShaderTextureNamePrefix("material.");
-    stbi_set_flip_vertically_on_load(true);
+    TextureLoader::setFlipVertically(true);
 
-    stbi_set_flip_vertically_on_load(false);
+    TextureLoader::setFlipVertically(false);
     Model platform("resources/objects/platform/untitled.obj");
     platform.SetShaderTextureNamePrefix("material.");
-    stbi_set_flip_vertically_on_load(true);
+    TextureLoader::setFlipVertically(true);
 
-    stbi_set_flip_vertically_on_load(false);
+    TextureLoader::setFlipVertically(false);
     Model ufo("resources/objects/ufo/scene.gltf");
     ufo.SetShaderTextureNamePrefix("material.");
-    stbi_set_flip_vertically_on_load(true);
+    TextureLoader::setFlipVertically(true);
 
     Model plant("resources/objects/plant/untitled.obj");
     plant.SetShaderTextureNamePrefix("material.");
 
-    stbi_set_flip_vertically_on_load(false);
+    TextureLoader::setFlipVertically(false);
     Model alien("resources/objects/alien/scene.gltf");
     alien.SetShaderTextureNamePrefix("material.");
-    stbi_set_flip_vertically_on_load(true);
+    TextureLoader::setFlipVertically(true);
 
-    stbi_set_flip_vertically_on_load(false);
+    TextureLoader::setFlipVertically(false);
     Model spaceship("resources/objects/spaceship/scene.gltf");
     spaceship.SetShaderTextureNamePrefix("material.");
-    stbi_set_flip_vertically_on_load(true);
+    TextureLoader::setFlipVertically(true);
+
+    // the programs of every loaded material are compiled now, with and without Blinn-Phong, instead of in
+    // the frame that first draws them
+    for (Model *loaded : {&mini_island, &tree, &meteor, &platform, &ufo, &plant, &alien, &spaceship}) {
+        for (const Mesh &mesh : loaded->meshes) {
+            modelShaders.precompile(mesh.shaderFeatures, SHADER_BLINN);
+            if (mesh.Bucket() == MATERIAL_BUCKET_OPAQUE)
+                depthShaders.precompile(mesh.shaderFeatures);
+        }
+    }
 
     // point light
     PointLight& pointLight = programState->pointLight;
@@ -391,9 +556,10 @@ int main() {
 
     //spotlight for ufo
     SpotLight& spotLight = programState->spotLight;
-    spotLight.position = glm::vec3(4.0f, 4.0, 0.0);
-    spotLight.ambient = glm::vec3(0.1, 0.1, 0.1);
-    spotLight.diffuse = glm::vec3(0.9f, 0.25f, 0.1f);
+    spotLight.position = glm::vec3(0.0f, 18.0f, 0.0f);
+    spotLight.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    spotLight.ambient = glm::vec3(20.0f);
+    spotLight.diffuse = glm::vec3(0.85f, 0.25f, 0.0f);
     spotLight.specular = glm::vec3(1.0f, 1.0f, 1.0f);
     spotLight.constant = 1.0f;
     spotLight.linear = 0.09f;
@@ -406,7 +572,7 @@ int main() {
 
     vector< glm::vec3 > meteor_positions;
     vector<float> sign = {-1, 1};
-    for(int i = 0; i < 200; i++) {
+    for(unsigned int i = 0; i < METEOR_COUNT; i++) {
         float meteor_x = 1.0f + static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / 20.0f));
         meteor_x *= sign[rand() % 2];
         float meteor_y = 1.0f + static_cast <float> (rand()) / (static_cast <float> (RAND_MAX / 20.0f));
@@ -419,6 +585,15 @@ int main() {
         meteor_positions.emplace_back(glm::vec3(meteor_x, meteor_y, meteor_z));
     }
 
+    // meteor model matrices, refilled every frame and handed to the render queue
+    vector< glm::mat4 > meteor_matrices(meteor_positions.size());
+    // visible meteors and their level of detail, sorted into meteor_matrices grouped by level
+    vector< glm::mat4 > visible_meteor_matrices(meteor_positions.size());
+    vector< unsigned int > visible_meteor_lods(meteor_positions.size());
+    vector< unsigned int > meteor_lod_first(meteor.LodCount() + 1);
+    // meteor vertices are quantized, every instance matrix carries the decode
+    glm::mat4 meteorDecode = meteor.PositionDecode();
+
     vector< glm::vec3 > island_positions;
     vector< float > islandScale;
     island_positions.emplace_back(glm::vec3(25.0f, 15.0f, -7.0f));
@@ -432,119 +607,199 @@ int main() {
     island_positions.emplace_back(glm::vec3(7.0f, -5.0f, 20.0f));
     islandScale.emplace_back(0.75f);
 
+    // culling counters, shown in the window title
+    CullStats cullStats;
+    float lastStatsTime = 0.0f;
+    RenderQueue renderQueue;
+    renderQueue.init(glLoader);
+    if (bench.enabled)
+        multiDrawIndirect = bench.multiDrawIndirect;
+    // the GPU culler gets the meteors as a static scene, their rotation and scale are applied every frame
+    GpuCuller gpuCuller;
+    if (gpuCuller.init(glLoader)) {
+        vector< glm::mat4 > meteor_instances;
+        for (const glm::vec3 &position : meteor_positions)
+            meteor_instances.push_back(glm::translate(glm::mat4(1.0f), position));
+        gpuCuller.setInstances(meteor, meteor_instances);
+    }
+    if (bench.enabled) {
+        gpuCulling = bench.gpuCulling;
+        if (gpuCulling && !gpuCuller.isSupported())
+            std::cout << "WARNING::BENCH:: --gpu-cull needs GL 4.3, culling on the CPU" << std::endl;
+    }
+    bool gpuCullingActive = false;
+    // every placed model and every meteor has an occlusion query object
+    OcclusionCuller occlusionCuller;
+    occlusionCuller.init(FRAME_DATA_BINDING);
+    vector< unsigned int > meteorOcclusionIds;
+    for (unsigned int i = 0; i < meteor_positions.size(); i++)
+        meteorOcclusionIds.push_back(occlusionCuller.add(false));
+    // models in the order the render loop places them, placedModels[i] is tested with modelOcclusionIds[i]
+    vector< Model* > placementOrder = {&tree};
+    placementOrder.insert(placementOrder.end(), island_positions.size(), &mini_island);
+    placementOrder.insert(placementOrder.end(), {&plant, &alien, &platform, &ufo, &spaceship});
+    vector< unsigned int > modelOcclusionIds;
+    for (Model *placed : placementOrder)
+        modelOcclusionIds.push_back(occlusionCuller.add(placed->TriangleCount() >= OCCLUSION_EXPENSIVE_TRIANGLES));
+    if (bench.enabled)
+        occlusionCulling = bench.occlusionCulling;
+    // GPU time of the depth pre-pass and of the lit model pass
+    GpuTimer prepassTimer;
+    GpuTimer litTimer;
+    if (bench.enabled)
+        depthPrepass = bench.depthPrepass;
+
+    BenchRecorder benchRecorder;
+    unsigned int benchFrame = 0;
+
     // render loop
-    while (!glfwWindowShouldClose(window)) {
-        // per-frame time logic
-        float currentFrame = glfwGetTime();
+    while (bench.enabled ? benchFrame < bench.warmupFrames + bench.frames : !glfwWindowShouldClose(window)) {
+        // per-frame time logic, benchmark frames advance by a fixed step
+        float currentFrame = bench.enabled ? benchFrame * BenchCameraPath::TIME_STEP : (float) glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         // input
-        processInput(window);
+        if (bench.enabled) {
+            BenchCameraPath::apply(programState->camera, currentFrame);
+            if (benchFrame == bench.warmupFrames)
+                benchRecorder.clear();
+            benchRecorder.beginFrame();
+        } else {
+            RenderStats::frame().reset();
+            processInput(window);
+        }
+        bool gpuCulledLastFrame = gpuCullingActive;
+        gpuCullingActive = gpuCulling && gpuCuller.isSupported();
+        // occlusion needs a depth texture, the window then renders into an offscreen target of its framebuffer's
+        // size and copies the image over. The target follows resizes and is released while culling on the CPU.
+        if (window) {
+            int framebufferWidth, framebufferHeight;
+            glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+            if (gpuCullingActive && framebufferWidth > 0 && framebufferHeight > 0) {
+                if (!offscreen || offscreen->width != framebufferWidth || offscreen->height != framebufferHeight)
+                    offscreen.reset(new Framebuffer(framebufferWidth, framebufferHeight));
+                offscreen->bind();
+            } else {
+                // a minimized window has nothing to render into, its frames are culled on the CPU
+                gpuCullingActive = false;
+                offscreen.reset();
+            }
+        }
+        // frames culled on the CPU build no depth pyramid, the first GPU frame after them only tests the frustum
+        if (gpuCullingActive && !gpuCulledLastFrame)
+            gpuCuller.resetHistory();
 
         // render
         glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        ourShader.use();
-
         // view/projection transformations
         glm::mat4 model = glm::mat4(1.0f);
         glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
-                                                (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 300.0f);
+                                                (float) SCR_WIDTH / (float) SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
         glm::mat4 view = programState->camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-        ourShader.setMat4("model", model);
+        Frustum frustum = programState->camera.GetFrustum(projection);
+        // levels of detail are switched while their error stays below a pixel
+        LodSelector lodSelector = LodSelector::fromView(programState->camera.Position, programState->camera.Zoom, (float) SCR_HEIGHT);
+        cullStats.reset();
+        // results of earlier frames' occlusion queries, read without waiting
+        if (occlusionCulling)
+            occlusionCuller.beginFrame();
+
+        // per-frame uniforms, one buffer write shared by all programs
+        pointLight.position = glm::vec3(30.0 * cos(currentFrame), 5.0f, 30.0 * sin(currentFrame));
+        FrameData frameData;
+        frameData.projection = projection;
+        frameData.view = view;
+        frameData.viewPosition = programState->camera.Position;
+        LightData lightData;
+        lightData.pointLights[0] = pointLight;
+        lightData.spotLight = spotLight;
+        frameUniforms.setBlock(0, frameData);
+        frameUniforms.setBlock(1, lightData);
+        frameUniforms.upload();
+
+        // B switches between Phong and Blinn-Phong programs
+        modelShaders.globalFeatures = blinn ? SHADER_BLINN : 0u;
 
         // cullface
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
-        glFrontFace(GL_CW);
+        glState.setEnabled(GL_CULL_FACE, true);
+        glState.cullFace(GL_BACK);
+        glState.frontFace(GL_CW);
 
         // render box
         boxShader.use();
         model = glm::translate(model, glm::vec3(-20.0f, -10.0f, 0.0f));
         model = glm::scale(model, glm::vec3(7.0f));
-        boxShader.setMat4("model", model);
-        boxShader.setMat4("view", view);
-        boxShader.setMat4("projection", projection);
-        glBindVertexArray(VAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture1);
+        boxShader.set(boxModel, model);
+        glState.bindVertexArray(VAO);
+        glState.bindTexture(0, GL_TEXTURE_2D, texture1);
         glDrawArrays(GL_TRIANGLES, 0, 36);
+        RenderStats::frame().addDraw(12);
 
-        glDisable(GL_CULL_FACE);
+        glState.setEnabled(GL_CULL_FACE, false);
 
         //skybox rendering
         //glDepthMask(GL_FALSE);
 
-        glDepthFunc(GL_LEQUAL);
+        glState.depthFunc(GL_LEQUAL);
         skyShader.use();
 
-        glm::mat4 viewCube = glm::mat4(glm::mat3(view));
-
-        glm::mat4 skyModel = glm::mat4(1.0f);
-        skyModel = glm::translate(skyModel, glm::vec3(0.0f, 0.0f, 0.0f));
-
-        skyShader.setMat4("view", viewCube);
-        skyShader.setMat4("projection", projection);
-        skyShader.setMat4("model", skyModel);
-
         // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        glState.bindVertexArray(skyboxVAO);
+        glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
+        RenderStats::frame().addDraw(12);
 
         //glDepthMask(GL_TRUE);
-        glDepthFunc(GL_LESS);
-
-        // point light uniforms
-        ourShader.use();
-        pointLight.position = glm::vec3(30.0 * cos(currentFrame), 5.0f, 30.0 * sin(currentFrame));
-        ourShader.setVec3("pointLight.position", pointLight.position);
-        ourShader.setVec3("pointLight.ambient", pointLight.ambient);
-        ourShader.setVec3("pointLight.diffuse", pointLight.diffuse);
-        ourShader.setVec3("pointLight.specular", pointLight.specular);
-        ourShader.setFloat("pointLight.constant", pointLight.constant);
-        ourShader.setFloat("pointLight.linear", pointLight.linear);
-        ourShader.setFloat("pointLight.quadratic", pointLight.quadratic);
-        ourShader.setVec3("viewPosition", programState->camera.Position);
-        ourShader.setFloat("material.shininess", 32.0f);
-        ourShader.setBool("blinn", blinn);
-
-        //spot light uniforms
-        ourShader.setVec3("spotLight.direction", glm::vec3(0.0f,-1.0f,0.0f));
-        ourShader.setVec3("spotLight.position", glm::vec3(0.0f, 18.0f,0.0f));
-        ourShader.setVec3("spotLight.ambient", glm::vec3(20.0f));
-        ourShader.setVec3("spotLight.diffuse", glm::vec3(0.85f, 0.25f, 0.0f));
-        ourShader.setVec3("spotLight.specular", spotLight.specular);
-        ourShader.setFloat("spotLight.constant", spotLight.constant);
-        ourShader.setFloat("spotLight.linear", spotLight.linear);
-        ourShader.setFloat("spotLight.quadratic", spotLight.quadratic);
-        ourShader.setFloat("spotLight.cutOff", spotLight.cutOff);
-        ourShader.setFloat("spotLight.outerCutOff", spotLight.outerCutOff);
+        glState.depthFunc(GL_LESS);
 
+        // models placed this frame, submitted to the render queue below, in placementOrder
+        vector< pair<Model*, glm::mat4> > placedModels;
 
         // render tree model
         model = glm::mat4(1.0f);
         model = glm::translate(model,
                                programState->treePosition);
         model = glm::scale(model, glm::vec3(programState->treeScale));
-        ourShader.setMat4("model", model);
-        tree.Draw(ourShader);
-
-        //render meteors
-        for(int i = 0; i < meteor_positions.size(); i++) {
+        placedModels.emplace_back(&tree, model);
+
+        //render meteors, only the visible ones go into the instance buffer, one instanced draw per mesh and level of detail
+        unsigned int visibleMeteors = 0;
+        glm::mat4 meteorAnimation = glm::rotate(glm::mat4(1.0f), currentFrame* glm::radians(10.0f), glm::vec3(1.0f, 0.0f, 1.0f));
+        meteorAnimation = glm::scale(meteorAnimation, glm::vec3(programState->meteorScale));
+        if (gpuCullingActive)
+            gpuCuller.cull(projection, view, meteorAnimation, lodSelector);
+        for(unsigned int i = 0; !gpuCullingActive && i < meteor_positions.size(); i++) {
             model = glm::mat4(1.0f);
-            model = glm::translate(model,meteor_positions[i]);
-            model = glm::rotate(model, currentFrame* glm::radians(10.0f), glm::vec3(1.0f, 0.0f, 1.0f));
-            model = glm::scale(model, glm::vec3(programState->meteorScale));
-            ourShader.setMat4("model", model);
-            meteor.Draw(ourShader);
+            model = glm::translate(model,meteor_positions[i]) * meteorAnimation;
+            if (!meteor.IsVisible(model, frustum)) {
+                cullStats.culled += meteor.meshes.size();
+                continue;
+            }
+            if (occlusionCulling) {
+                unsigned int occlusionId = meteorOcclusionIds[i];
+                OcclusionDecision decision = occlusionCuller.decide(occlusionId);
+                occlusionCuller.test(occlusionId, meteor.bounds.transformed(model));
+                if (decision != OCCLUSION_DRAW) {
+                    cullStats.occluded += meteor.meshes.size();
+                    continue;
+                }
+            }
+            visible_meteor_lods[visibleMeteors] = meteor.SelectLod(model, lodSelector);
+            visible_meteor_matrices[visibleMeteors++] = model * meteorDecode;
         }
+        // counting sort by level, instances of a level are drawn from one contiguous range
+        std::fill(meteor_lod_first.begin(), meteor_lod_first.end(), 0);
+        for (unsigned int i = 0; i < visibleMeteors; i++)
+            meteor_lod_first[visible_meteor_lods[i] + 1]++;
+        for (unsigned int lod = 1; lod < meteor_lod_first.size(); lod++)
+            meteor_lod_first[lod] += meteor_lod_first[lod - 1];
+        vector< unsigned int > meteor_lod_fill(meteor_lod_first.begin(), meteor_lod_first.end() - 1);
+        for (unsigned int i = 0; i < visibleMeteors; i++)
+            meteor_matrices[meteor_lod_fill[visible_meteor_lods[i]]++] = visible_meteor_matrices[i];
+        cullStats.drawn += visibleMeteors * meteor.meshes.size();
 
         // render islands
         for(int i = 0; i < island_positions.size(); i++) {
@@ -552,8 +807,7 @@ int main() {
             model = glm::translate(model,island_positions[i]);
             model = glm::scale(model, glm::vec3(islandScale[i]));
             model = glm::rotate(model, currentFrame*glm::radians(7.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-            ourShader.setMat4("model", model);
-            mini_island.Draw(ourShader);
+            placedModels.emplace_back(&mini_island, model);
         }
 
         // render plant model
@@ -561,16 +815,14 @@ int main() {
         model = glm::translate(model,
                                programState->plantPosition);
         model = glm::scale(model, glm::vec3(programState->plantScale));
-        ourShader.setMat4("model", model);
-        plant.Draw(ourShader);
+        placedModels.emplace_back(&plant, model);
 
         // render alien model
         model = glm::mat4(1.0f);
         model = glm::translate(model,
                                programState->alienPosition);
         model = glm::scale(model, glm::vec3(programState->alienScale));
-        ourShader.setMat4("model", model);
-        alien.Draw(ourShader);
+        placedModels.emplace_back(&alien, model);
 
         /*
         if (programState->ImGuiEnabled)
@@ -582,8 +834,7 @@ int main() {
         model = glm::translate(model,
                                programState->platformPosition);
         model = glm::scale(model, glm::vec3(programState->platformScale));
-        ourShader.setMat4("model", model);
-        platform.Draw(ourShader);
+        placedModels.emplace_back(&platform, model);
 
         // render ufo model
         model = glm::mat4(1.0f);
@@ -591,8 +842,7 @@ int main() {
                                programState->ufoPosition);
         model = glm::scale(model, glm::vec3(programState->ufoScale));
         model = glm::rotate(model, currentFrame*glm::radians(50.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        ufo.Draw(ourShader);
+        placedModels.emplace_back(&ufo, model);
 
         // render spaceship model
         model = glm::mat4(1.0f);
@@ -600,23 +850,118 @@ int main() {
                                programState->spaceshipPosition);
         model = glm::scale(model, glm::vec3(programState->spaceshipScale));
         model = glm::rotate(model, glm::radians(220.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        spaceship.Draw(ourShader);
+        placedModels.emplace_back(&spaceship, model);
+
+        // every model mesh goes through the render queue, sorted by pass, program, material and mesh, front
+        // to back within each group
+        renderQueue.setView(programState->camera.Position, FAR_PLANE);
+        renderQueue.useMultiDrawIndirect = multiDrawIndirect;
+        ShaderVariants *prepassShaders = depthPrepass ? &depthShaders : nullptr;
+        for (unsigned int i = 0; i < placedModels.size(); i++) {
+            Model &placedModel = *placedModels[i].first;
+            const glm::mat4 &placement = placedModels[i].second;
+            // only models inside the frustum are tested, the frustum test in Submit takes care of the others
+            OcclusionDecision decision = OCCLUSION_DRAW;
+            if (occlusionCulling && placedModel.IsVisible(placement, frustum)) {
+                decision = occlusionCuller.decide(modelOcclusionIds[i]);
+                occlusionCuller.test(modelOcclusionIds[i], placedModel.bounds.transformed(placement));
+            }
+            if (decision == OCCLUSION_SKIP) {
+                cullStats.occluded += placedModel.meshes.size();
+                continue;
+            }
+            if (decision == OCCLUSION_DRAW_CONDITIONAL)
+                renderQueue.beginCondition(occlusionCuller.condition(modelOcclusionIds[i]));
+            placedModel.Submit(renderQueue, modelShaders, prepassShaders, placement, frustum, lodSelector, cullStats);
+            renderQueue.endCondition();
+        }
+        if (gpuCullingActive)
+            gpuCuller.submit(renderQueue, modelShaders, prepassShaders);
+        unsigned int firstMeteor = renderQueue.addTransforms(meteor_matrices.data(), visibleMeteors);
+        for (unsigned int lod = 0; !gpuCullingActive && lod + 1 < meteor_lod_first.size(); lod++) {
+            unsigned int count = meteor_lod_first[lod + 1] - meteor_lod_first[lod];
+            if (count > 0)
+                meteor.SubmitInstanced(renderQueue, modelShaders, prepassShaders, lod, firstMeteor + meteor_lod_first[lod], count);
+        }
+        renderQueue.prepare();
+
+        // depth pre-pass: opaque meshes write depth only, the lit pass below then only passes GL_EQUAL
+        // fragments and shades each pixel once. Alpha-masked meshes are left out, their depth depends on
+        // the discard in the lit program.
+        if (depthPrepass) {
+            prepassTimer.begin();
+            glState.colorMask(false);
+            renderQueue.execute(RENDER_PASS_DEPTH);
+            glState.colorMask(true);
+            prepassTimer.end();
+        }
 
+        // opaque materials first, their programs never discard so early depth testing rejects everything
+        // they hide, alpha-masked materials after them
+        litTimer.begin();
+        if (depthPrepass) {
+            glState.depthFunc(GL_EQUAL);
+            glState.depthMask(false);
+        }
+        renderQueue.execute(RENDER_PASS_OPAQUE);
+        glState.depthFunc(GL_LESS);
+        glState.depthMask(true);
+        renderQueue.execute(RENDER_PASS_ALPHA_MASK);
+        litTimer.end();
+        renderQueue.clear();
+
+        // bounding boxes of the tested objects against the finished depth buffer, read in a later frame
+        if (occlusionCulling)
+            occlusionCuller.issue(programState->camera.Position, NEAR_PLANE);
+
+        // next frame's occlusion test reads this frame's depth
+        if (gpuCullingActive) {
+            gpuCuller.buildDepthPyramid(offscreen->depthTexture, offscreen->width, offscreen->height, projection * view);
+            if (window) {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreen->ID);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+                glBlitFramebuffer(0, 0, offscreen->width, offscreen->height, 0, 0, offscreen->width, offscreen->height,
+                                  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                glViewport(0, 0, offscreen->width, offscreen->height);
+            }
+        }
+
+        if (bench.enabled) {
+            if (depthPrepass && prepassTimer.ready())
+                benchRecorder.addTiming("gpu_prepass", prepassTimer.lastMilliseconds());
+            if (litTimer.ready())
+                benchRecorder.addTiming("gpu_lit", litTimer.lastMilliseconds());
+            benchRecorder.endFrame();
+            benchFrame++;
+            continue;
+        }
+
+        // culling counters in the window title, refreshed once a second
+        if (currentFrame - lastStatsTime >= 1.0f) {
+            lastStatsTime = currentFrame;
+            char passTimes[96];
+            std::snprintf(passTimes, sizeof(passTimes), " | prepass %s %.2f ms | lit %.2f ms", depthPrepass ? "on" : "off",
+                          depthPrepass ? prepassTimer.lastMilliseconds() : 0.0, litTimer.lastMilliseconds());
+            const RenderStats &renderStats = RenderStats::frame();
+            std::string title = "LearnOpenGL | drawn " + std::to_string(cullStats.drawn) +
+                                " | culled " + std::to_string(cullStats.culled) +
+                                (occlusionCulling ? " | occluded " + std::to_string(cullStats.occluded) : "") + passTimes +
+                                " | gl state " + std::to_string(renderStats.stateCalls) + " issued, " +
+                                std::to_string(renderStats.redundantStateCalls) + " skipped" +
+                                " | " + std::to_string(renderStats.drawCalls) + " draws" +
+                                (renderQueue.supportsMultiDrawIndirect() && multiDrawIndirect ? " (mdi)" : "") +
+                                (gpuCullingActive ? " | meteors culled on the GPU" : "");
+            glfwSetWindowTitle(window, title.c_str());
+        }
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
-    programState->SaveToFile("resources/program_state.txt");
-    delete programState;
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
-
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    glfwTerminate();
+    if (bench.enabled)
+        return benchRecorder.write(bench.outputPath, SCR_WIDTH, SCR_HEIGHT) ? 0 : -1;
     return 0;
 }
 
@@ -642,6 +987,36 @@ void processInput(GLFWwindow *window) {
         blinn = !blinn;
         blinnKeyPressed = true;
     }
+    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_RELEASE)
+        blinnKeyPressed = false;
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && !depthPrepassKeyPressed)
+    {
+        depthPrepass = !depthPrepass;
+        depthPrepassKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_RELEASE)
+        depthPrepassKeyPressed = false;
+    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS && !multiDrawIndirectKeyPressed)
+    {
+        multiDrawIndirect = !multiDrawIndirect;
+        multiDrawIndirectKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_RELEASE)
+        multiDrawIndirectKeyPressed = false;
+    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS && !gpuCullingKeyPressed)
+    {
+        gpuCulling = !gpuCulling;
+        gpuCullingKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_RELEASE)
+        gpuCullingKeyPressed = false;
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS && !occlusionCullingKeyPressed)
+    {
+        occlusionCulling = !occlusionCulling;
+        occlusionCullingKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE)
+        occlusionCullingKeyPressed = false;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -727,69 +1102,11 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 
 unsigned int loadTexture(char const * path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureRegistry::shared().load2D(path);
 }
 
+// the six faces are decoded concurrently, only the uploads run on this thread
 unsigned int loadCubemap(vector<std::string> faces)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                         0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-            );
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap tex failed to load at this path : " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    return TextureRegistry::shared().loadCubemap(faces);
 }